@@ -0,0 +1,107 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Identifier hashing benchmark
+//
+// Times hash_text, same_text and the symbol interner on a generated
+// stream of identifiers shaped like those in a large program: a few
+// thousand distinct names from 1 to 64 characters, each used many
+// times.  The analyzer is included whole so its static helpers are in
+// reach; run.sh builds it with AVX2, with SSE2 only, and with
+// -DSEMANT_NO_SIMD, and the three must print the same checksums.
+//
+//   hash_bench [distinct names] [identifier uses]
+//
+//////////////////////////////////////////////////////////////////////
+
+#include <string>
+#include "semant.cc"
+
+static const char *simd_level()
+{
+#if defined(SEMANT_SIMD) && defined(__AVX2__)
+    return "avx2";
+#elif defined(SEMANT_SIMD)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+/* a small deterministic generator, so every build sees the same input. */
+static unsigned long long bench_random(unsigned long long &state)
+{
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+static void report_rate(const char *what, size_t uses, size_t bytes, double seconds, unsigned int checksum)
+{
+    printf("  %-10s %8.2f ns/identifier %8.2f GB/s  checksum %08x\n", what,
+           seconds * 1e9 / uses, bytes / seconds / 1e9, checksum);
+}
+
+int main(int argc, char **argv)
+{
+    size_t distinct = argc>1 ? strtoul(argv[1], NULL, 10) : 4096;
+    size_t uses = argc>2 ? strtoul(argv[2], NULL, 10) : 4000000;
+    if(distinct==0 || uses==0)
+    {
+        fprintf(stderr, "usage: hash_bench [distinct names] [identifier uses]\n");
+        return 2;
+    }
+
+    /* names: mostly short, as locals and methods are, with a tail of long ones. */
+    unsigned long long state = 0x2545f4914f6cdd1dULL;
+    std::vector<std::string> names(distinct);
+    static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz_ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+    for(size_t i=0; i<distinct; i++)
+    {
+        size_t length = 1 + bench_random(state) % (bench_random(state) % 4==0 ? 64 : 12);
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "%zx", i);
+        names[i] = buffer;
+        while(names[i].size() < length)
+            names[i] += alphabet[bench_random(state) % (sizeof(alphabet) - 1)];
+        names[i][0] = 'a' + i % 26;
+    }
+
+    /* the uses, skewed toward the first names like a Zipf distribution; each is a private copy. */
+    std::vector<std::string> stream(uses);
+    std::vector<unsigned int> which(uses);
+    size_t bytes = 0;
+    for(size_t i=0; i<uses; i++)
+    {
+        unsigned long long r = bench_random(state);
+        which[i] = (r % distinct) * (r / distinct % distinct) / distinct;
+        stream[i] = names[which[i]];
+        bytes += stream[i].size();
+    }
+
+    printf("%s: %zu names, %zu uses, %.1f bytes each\n", simd_level(), distinct, uses, (double) bytes / uses);
+
+    unsigned int checksum = 0;
+    double started = wall_clock();
+    for(size_t i=0; i<uses; i++)
+        checksum = checksum * 31 + hash_text(stream[i].data(), stream[i].size());
+    report_rate("hash_text", uses, bytes, wall_clock() - started, checksum);
+
+    unsigned int same = 0;
+    started = wall_clock();
+    for(size_t i=0; i<uses; i++)
+    {
+        const std::string &name = names[which[i]];
+        same += same_text(stream[i].data(), name.data(), name.size());
+    }
+    report_rate("same_text", uses, bytes, wall_clock() - started, same);
+
+    /* the interner hashes as the reader does, so this is the whole per-token cost. */
+    std::vector<Symbol> symbols(uses);
+    started = wall_clock();
+    for(size_t i=0; i<uses; i++)
+        symbols[i] = symbol_interner.intern(ID_SYMBOL, &stream[i][0], stream[i].size(),
+                                            hash_text(stream[i].data(), stream[i].size()));
+    report_rate("intern", uses, bytes, wall_clock() - started, symbol_interner.size());
+    return 0;
+}
@@ -0,0 +1,28 @@
+#!/bin/sh
+#
+# Identifier hashing benchmark, with and without SIMD.
+#
+#   bench/run.sh [PA4 directory] [distinct names] [identifier uses]
+#
+# The directory (default: the current one) is an assignment directory
+# in which this semant.cc has been built with `make semant'.
+# hash_bench.cc includes its semant.cc and links against the other
+# objects, once for each of AVX2, SSE2 and -DSEMANT_NO_SIMD.
+#
+
+BENCH=$(cd "$(dirname "$0")" && pwd)
+PA4=$(cd "${1:-.}" && pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+[ $# -gt 0 ] && shift
+
+OBJS=$(ls "$PA4"/*.o | grep -v '/semant\.o$' | grep -v '/semant-phase\.o$')
+for variant in "avx2 -mavx2" "sse2 -msse2" "scalar -DSEMANT_NO_SIMD"; do
+    set -- $variant "$@"
+    name=$1
+    flags=$2
+    shift 2
+    ${CXX:-g++} -O2 $flags -Wno-write-strings -I"$PA4" -I"$PA4/../../include/PA4" \
+        "$BENCH/hash_bench.cc" $OBJS -pthread -o "$WORK/$name" || exit 1
+    "$WORK/$name" "$@"
+done
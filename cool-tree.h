@@ -9,10 +9,22 @@
 //////////////////////////////////////////////////////////
 
 
+#include <map>
+#include <vector>
 #include "tree.h"
 #include "cool-tree.handcode.h"
 
 
+/* callback used by traverse() to visit every node of a tree in preorder. */
+typedef void (*tree_visitor)(tree_node *node, size_t bytes, void *data);
+
+/* flat, index-based copy of a tree; defined at the end of this file. */
+class CompactAst;
+
+/* one slot of a class's feature index (see semant.cc). */
+struct feature_slot;
+
+
 // define the class for phylum
 // define simple phylum - Program
 typedef class Program_class *Program;
@@ -21,6 +33,10 @@ class Program_class : public tree_node {
 public:
    tree_node *copy()     { return copy_Program(); }
    virtual Program copy_Program() = 0;
+   virtual void traverse(tree_visitor, void *) = 0;
+   virtual unsigned int compact(CompactAst &) = 0;
+
+   virtual Classes get_classes() = 0;
 
 #ifdef Program_EXTRAS
    Program_EXTRAS
@@ -35,11 +51,16 @@ class Class__class : public tree_node {
 public:
    tree_node *copy()     { return copy_Class_(); }
    virtual Class_ copy_Class_() = 0;
+   virtual void traverse(tree_visitor, void *) = 0;
+   virtual unsigned int compact(CompactAst &) = 0;
 
    virtual void dump(ostream &stream, int n) = 0;
    virtual Symbol get_name() = 0;
    virtual Symbol get_parent() = 0;
    virtual Features get_features() = 0;
+   virtual void index_features() = 0;
+   virtual Feature find_method(Symbol) = 0;
+   virtual Feature find_attr(Symbol) = 0;
 
 #ifdef Class__EXTRAS
    Class__EXTRAS
@@ -54,12 +75,17 @@ class Feature_class : public tree_node {
 public:
    tree_node *copy()     { return copy_Feature(); }
    virtual Feature copy_Feature() = 0;
+   virtual void traverse(tree_visitor, void *) = 0;
+   virtual unsigned int compact(CompactAst &) = 0;
 
+   virtual void check_declaration(Class_) = 0;
    virtual void add_to_symbol_table(Feature, Class_) = 0;
    virtual Formals get_formals() = 0;
    virtual Symbol get_return_type() = 0;
    virtual void check_feature(Class_) = 0;
    virtual Symbol get_name()  = 0;
+   virtual int get_signature() = 0;
+   virtual void set_signature(int) = 0;
 #ifdef Feature_EXTRAS
    Feature_EXTRAS
 #endif
@@ -73,6 +99,8 @@ class Formal_class : public tree_node {
 public:
    tree_node *copy()     { return copy_Formal(); }
    virtual Formal copy_Formal() = 0;
+   virtual void traverse(tree_visitor, void *) = 0;
+   virtual unsigned int compact(CompactAst &) = 0;
 
    virtual Symbol get_name() = 0;
    virtual Symbol get_type() = 0;
@@ -86,13 +114,61 @@ public:
 // define simple phylum - Expression
 typedef class Expression_class *Expression;
 
+/* values of Expression_class::void_source other than a local's index. */
+enum { NEVER_VOID = -2, MAYBE_VOID = -1 };
+
+/* the value checking folded an expression to, valid once `folded' is set. */
+struct folded_constant {
+   bool folded;
+   int value;
+   folded_constant() {
+      folded = false;
+      value = 0;
+   }
+};
+
 class Expression_class : public tree_node {
+protected:
+   int void_source;
+   folded_constant constant;
 public:
    tree_node *copy()     { return copy_Expression(); }
    virtual Expression copy_Expression() = 0;
+   virtual void traverse(tree_visitor, void *) = 0;
+   virtual unsigned int compact(CompactAst &) = 0;
 
    virtual Symbol get_expression_type(Class_) = 0;
 
+   /* true, with the value in the argument, if checking folded the expression to a constant. */
+   bool get_constant(int &value)
+   {
+      value = constant.value;
+      return constant.folded;
+   }
+
+   void set_constant(int value)
+   {
+      constant.folded = true;
+      constant.value = value;
+   }
+
+   /* NEVER_VOID if the non-void analysis proved the value is never void. */
+   int get_void_source()
+   {
+      return void_source;
+   }
+
+   void set_void_source(int source)
+   {
+      void_source = source;
+   }
+
+   /* for a dispatch, the method its static receiver type resolves to. */
+   virtual Feature get_resolved_method(Class_ *)
+   {
+      return NULL;
+   }
+
 #ifdef Expression_EXTRAS
    Expression_EXTRAS
 #endif
@@ -106,6 +182,13 @@ class Case_class : public tree_node {
 public:
    tree_node *copy()     { return copy_Case(); }
    virtual Case copy_Case() = 0;
+   virtual void traverse(tree_visitor, void *) = 0;
+   virtual unsigned int compact(CompactAst &) = 0;
+
+   virtual Symbol check_branch(Class_) = 0;
+   virtual Symbol get_type_decl() = 0;
+   virtual Expression get_expr() = 0;
+   virtual void set_tag_range(int, int) = 0;
 
 #ifdef Case_EXTRAS
    Case_EXTRAS
@@ -150,6 +233,13 @@ public:
    }
    Program copy_Program();
    void dump(ostream& stream, int n);
+   void traverse(tree_visitor, void *);
+   unsigned int compact(CompactAst &);
+
+   Classes get_classes()
+   {
+      return classes;
+   }
 
 #ifdef Program_SHARED_EXTRAS
    Program_SHARED_EXTRAS
@@ -167,15 +257,22 @@ protected:
    Symbol parent;
    Features features;
    Symbol filename;
+   /* the first method and attribute of each name, open-addressed by name. */
+   feature_slot *feature_slots;
+   unsigned int feature_mask;
 public:
    class__class(Symbol a1, Symbol a2, Features a3, Symbol a4) {
       name = a1;
       parent = a2;
       features = a3;
       filename = a4;
+      feature_slots = NULL;
+      feature_mask = 0;
    }
    Class_ copy_Class_();
    void dump(ostream& stream, int n);
+   void traverse(tree_visitor, void *);
+   unsigned int compact(CompactAst &);
 
    Symbol get_name()
    {
@@ -192,6 +289,10 @@ public:
       return features;
    }
 
+   void index_features();
+   Feature find_method(Symbol);
+   Feature find_attr(Symbol);
+
 #ifdef Class__SHARED_EXTRAS
    Class__SHARED_EXTRAS
 #endif
@@ -208,16 +309,21 @@ protected:
    Formals formals;
    Symbol return_type;
    Expression expr;
+   int signature;
 public:
    method_class(Symbol a1, Formals a2, Symbol a3, Expression a4) {
       name = a1;
       formals = a2;
       return_type = a3;
       expr = a4;
+      signature = -1;
    }
    Feature copy_Feature();
    void dump(ostream& stream, int n);
+   void traverse(tree_visitor, void *);
+   unsigned int compact(CompactAst &);
    void check_feature(Class_);
+   void check_declaration(Class_);
    void add_to_symbol_table(Feature, Class_);
    Formals get_formals()
    {
@@ -234,6 +340,16 @@ public:
       return return_type;
    }
 
+   int get_signature()
+   {
+      return signature;
+   }
+
+   void set_signature(int s)
+   {
+      signature = s;
+   }
+
 #ifdef Feature_SHARED_EXTRAS
    Feature_SHARED_EXTRAS
 #endif
@@ -257,7 +373,10 @@ public:
    }
    Feature copy_Feature();
    void dump(ostream& stream, int n);
+   void traverse(tree_visitor, void *);
+   unsigned int compact(CompactAst &);
    void check_feature(Class_);
+   void check_declaration(Class_);
    void add_to_symbol_table(Feature, Class_);
    Formals get_formals()
    {
@@ -274,6 +393,15 @@ public:
       return type_decl;
    }
 
+   int get_signature()
+   {
+      return -1;
+   }
+
+   void set_signature(int)
+   {
+   }
+
 #ifdef Feature_SHARED_EXTRAS
    Feature_SHARED_EXTRAS
 #endif
@@ -295,6 +423,8 @@ public:
    }
    Formal copy_Formal();
    void dump(ostream& stream, int n);
+   void traverse(tree_visitor, void *);
+   unsigned int compact(CompactAst &);
 
    Symbol get_name()
    {
@@ -321,14 +451,48 @@ protected:
    Symbol name;
    Symbol type_decl;
    Expression expr;
+   int tag_low;
+   int tag_high;
 public:
    branch_class(Symbol a1, Symbol a2, Expression a3) {
       name = a1;
       type_decl = a2;
       expr = a3;
+      tag_low = -1;
+      tag_high = -1;
    }
    Case copy_Case();
    void dump(ostream& stream, int n);
+   void traverse(tree_visitor, void *);
+   unsigned int compact(CompactAst &);
+   Symbol check_branch(Class_);
+
+   Symbol get_type_decl()
+   {
+      return type_decl;
+   }
+
+   Expression get_expr()
+   {
+      return expr;
+   }
+
+   /* the branch matches objects whose class tag lies in [low, high]. */
+   void set_tag_range(int low, int high)
+   {
+      tag_low = low;
+      tag_high = high;
+   }
+
+   int get_tag_low()
+   {
+      return tag_low;
+   }
+
+   int get_tag_high()
+   {
+      return tag_high;
+   }
 
 #ifdef Case_SHARED_EXTRAS
    Case_SHARED_EXTRAS
@@ -348,9 +512,12 @@ public:
    assign_class(Symbol a1, Expression a2) {
       name = a1;
       expr = a2;
+      void_source = MAYBE_VOID;
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
+   void traverse(tree_visitor, void *);
+   unsigned int compact(CompactAst &);
 
    Symbol get_expression_type(Class_);
 
@@ -370,16 +537,42 @@ protected:
    Symbol type_name;
    Symbol name;
    Expressions actual;
+   Feature resolved;
+   Class_ resolved_class;
 public:
    static_dispatch_class(Expression a1, Symbol a2, Symbol a3, Expressions a4) {
       expr = a1;
       type_name = a2;
       name = a3;
       actual = a4;
+      resolved = NULL;
+      resolved_class = NULL;
+      void_source = MAYBE_VOID;
    }
    Expression copy_Expression();
    Symbol get_expression_type(Class_);
    void dump(ostream& stream, int n);
+   void traverse(tree_visitor, void *);
+   unsigned int compact(CompactAst &);
+
+   /* true if the receiver needs no void check at run time. */
+   bool receiver_non_void()
+   {
+      return expr->get_void_source()==NEVER_VOID;
+   }
+
+   Feature get_resolved_method(Class_ *defining)
+   {
+      if(defining!=NULL)
+         *defining = resolved_class;
+      return resolved;
+   }
+
+   void set_resolved_method(Feature f, Class_ c)
+   {
+      resolved = f;
+      resolved_class = c;
+   }
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -396,15 +589,62 @@ protected:
    Expression expr;
    Symbol name;
    Expressions actual;
+   Feature target;
+   Class_ target_class;
+   Feature resolved;
+   Class_ resolved_class;
 public:
    dispatch_class(Expression a1, Symbol a2, Expressions a3) {
       expr = a1;
       name = a2;
       actual = a3;
+      target = NULL;
+      target_class = NULL;
+      resolved = NULL;
+      resolved_class = NULL;
+      void_source = MAYBE_VOID;
    }
    Expression copy_Expression();
    Symbol get_expression_type(Class_);
    void dump(ostream& stream, int n);
+   void traverse(tree_visitor, void *);
+   unsigned int compact(CompactAst &);
+
+   /* true if the receiver needs no void check at run time. */
+   bool receiver_non_void()
+   {
+      return expr->get_void_source()==NEVER_VOID;
+   }
+
+   Feature get_resolved_method(Class_ *defining)
+   {
+      if(defining!=NULL)
+         *defining = resolved_class;
+      return resolved;
+   }
+
+   void set_resolved_method(Feature f, Class_ c)
+   {
+      resolved = f;
+      resolved_class = c;
+   }
+
+   /* the only method this call can reach, or NULL if it is not monomorphic. */
+   Feature get_target()
+   {
+      return target;
+   }
+
+   Class_ get_target_class()
+   {
+      return target_class;
+   }
+
+   void set_target(Feature f, Class_ c)
+   {
+      target = f;
+      target_class = c;
+   }
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -421,15 +661,26 @@ protected:
    Expression pred;
    Expression then_exp;
    Expression else_exp;
+   int known_pred;
 public:
    cond_class(Expression a1, Expression a2, Expression a3) {
       pred = a1;
       then_exp = a2;
       else_exp = a3;
+      known_pred = -1;
+      void_source = MAYBE_VOID;
    }
    Expression copy_Expression();
    Symbol get_expression_type(Class_);
    void dump(ostream& stream, int n);
+   void traverse(tree_visitor, void *);
+   unsigned int compact(CompactAst &);
+
+   /* -1 unless the predicate folded to a constant, then its value. */
+   int get_known_pred()
+   {
+      return known_pred;
+   }
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -445,14 +696,25 @@ class loop_class : public Expression_class {
 protected:
    Expression pred;
    Expression body;
+   int known_pred;
 public:
    loop_class(Expression a1, Expression a2) {
       pred = a1;
       body = a2;
+      known_pred = -1;
+      void_source = MAYBE_VOID;
    }
    Expression copy_Expression();
    Symbol get_expression_type(Class_);
    void dump(ostream& stream, int n);
+   void traverse(tree_visitor, void *);
+   unsigned int compact(CompactAst &);
+
+   /* -1 unless the predicate folded to a constant, then its value. */
+   int get_known_pred()
+   {
+      return known_pred;
+   }
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -468,14 +730,25 @@ class typcase_class : public Expression_class {
 protected:
    Expression expr;
    Cases cases;
+   std::vector<Case> sorted_cases;
 public:
    typcase_class(Expression a1, Cases a2) {
       expr = a1;
       cases = a2;
+      void_source = MAYBE_VOID;
    }
    Expression copy_Expression();
    Symbol get_expression_type(Class_);
    void dump(ostream& stream, int n);
+   void traverse(tree_visitor, void *);
+   unsigned int compact(CompactAst &);
+   void annotate_branches();
+
+   /* the branches, most specific first, once annotate_branches has run. */
+   const std::vector<Case> &get_sorted_cases()
+   {
+      return sorted_cases;
+   }
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -493,10 +766,13 @@ protected:
 public:
    block_class(Expressions a1) {
       body = a1;
+      void_source = MAYBE_VOID;
    }
    Expression copy_Expression();
    Symbol get_expression_type(Class_);
    void dump(ostream& stream, int n);
+   void traverse(tree_visitor, void *);
+   unsigned int compact(CompactAst &);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -520,10 +796,13 @@ public:
       type_decl = a2;
       init = a3;
       body = a4;
+      void_source = MAYBE_VOID;
    }
    Expression copy_Expression();
    Symbol get_expression_type(Class_);
    void dump(ostream& stream, int n);
+   void traverse(tree_visitor, void *);
+   unsigned int compact(CompactAst &);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -543,10 +822,13 @@ public:
    plus_class(Expression a1, Expression a2) {
       e1 = a1;
       e2 = a2;
+      void_source = MAYBE_VOID;
    }
    Expression copy_Expression();
    Symbol get_expression_type(Class_);
    void dump(ostream& stream, int n);
+   void traverse(tree_visitor, void *);
+   unsigned int compact(CompactAst &);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -566,10 +848,13 @@ public:
    sub_class(Expression a1, Expression a2) {
       e1 = a1;
       e2 = a2;
+      void_source = MAYBE_VOID;
    }
    Expression copy_Expression();
    Symbol get_expression_type(Class_);
    void dump(ostream& stream, int n);
+   void traverse(tree_visitor, void *);
+   unsigned int compact(CompactAst &);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -589,10 +874,13 @@ public:
    mul_class(Expression a1, Expression a2) {
       e1 = a1;
       e2 = a2;
+      void_source = MAYBE_VOID;
    }
    Expression copy_Expression();
    Symbol get_expression_type(Class_);
    void dump(ostream& stream, int n);
+   void traverse(tree_visitor, void *);
+   unsigned int compact(CompactAst &);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -612,10 +900,13 @@ public:
    divide_class(Expression a1, Expression a2) {
       e1 = a1;
       e2 = a2;
+      void_source = MAYBE_VOID;
    }
    Expression copy_Expression();
    Symbol get_expression_type(Class_);
    void dump(ostream& stream, int n);
+   void traverse(tree_visitor, void *);
+   unsigned int compact(CompactAst &);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -633,10 +924,13 @@ protected:
 public:
    neg_class(Expression a1) {
       e1 = a1;
+      void_source = MAYBE_VOID;
    }
    Expression copy_Expression();
    Symbol get_expression_type(Class_);
    void dump(ostream& stream, int n);
+   void traverse(tree_visitor, void *);
+   unsigned int compact(CompactAst &);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -656,10 +950,13 @@ public:
    lt_class(Expression a1, Expression a2) {
       e1 = a1;
       e2 = a2;
+      void_source = MAYBE_VOID;
    }
    Expression copy_Expression();
    Symbol get_expression_type(Class_);
    void dump(ostream& stream, int n);
+   void traverse(tree_visitor, void *);
+   unsigned int compact(CompactAst &);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -679,10 +976,13 @@ public:
    eq_class(Expression a1, Expression a2) {
       e1 = a1;
       e2 = a2;
+      void_source = MAYBE_VOID;
    }
    Expression copy_Expression();
    Symbol get_expression_type(Class_);
    void dump(ostream& stream, int n);
+   void traverse(tree_visitor, void *);
+   unsigned int compact(CompactAst &);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -702,10 +1002,13 @@ public:
    leq_class(Expression a1, Expression a2) {
       e1 = a1;
       e2 = a2;
+      void_source = MAYBE_VOID;
    }
    Expression copy_Expression();
    Symbol get_expression_type(Class_);
    void dump(ostream& stream, int n);
+   void traverse(tree_visitor, void *);
+   unsigned int compact(CompactAst &);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -723,10 +1026,13 @@ protected:
 public:
    comp_class(Expression a1) {
       e1 = a1;
+      void_source = MAYBE_VOID;
    }
    Expression copy_Expression();
    Symbol get_expression_type(Class_);
    void dump(ostream& stream, int n);
+   void traverse(tree_visitor, void *);
+   unsigned int compact(CompactAst &);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -744,10 +1050,13 @@ protected:
 public:
    int_const_class(Symbol a1) {
       token = a1;
+      void_source = MAYBE_VOID;
    }
    Expression copy_Expression();
    Symbol get_expression_type(Class_);
    void dump(ostream& stream, int n);
+   void traverse(tree_visitor, void *);
+   unsigned int compact(CompactAst &);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -765,10 +1074,13 @@ protected:
 public:
    bool_const_class(Boolean a1) {
       val = a1;
+      void_source = MAYBE_VOID;
    }
    Expression copy_Expression();
    Symbol get_expression_type(Class_);
    void dump(ostream& stream, int n);
+   void traverse(tree_visitor, void *);
+   unsigned int compact(CompactAst &);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -786,10 +1098,13 @@ protected:
 public:
    string_const_class(Symbol a1) {
       token = a1;
+      void_source = MAYBE_VOID;
    }
    Expression copy_Expression();
    Symbol get_expression_type(Class_);
    void dump(ostream& stream, int n);
+   void traverse(tree_visitor, void *);
+   unsigned int compact(CompactAst &);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -807,10 +1122,13 @@ protected:
 public:
    new__class(Symbol a1) {
       type_name = a1;
+      void_source = MAYBE_VOID;
    }
    Expression copy_Expression();
    Symbol get_expression_type(Class_);
    void dump(ostream& stream, int n);
+   void traverse(tree_visitor, void *);
+   unsigned int compact(CompactAst &);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -828,10 +1146,19 @@ protected:
 public:
    isvoid_class(Expression a1) {
       e1 = a1;
+      void_source = MAYBE_VOID;
    }
    Expression copy_Expression();
    Symbol get_expression_type(Class_);
    void dump(ostream& stream, int n);
+   void traverse(tree_visitor, void *);
+   unsigned int compact(CompactAst &);
+
+   /* true if the operand is never void, so the test is always false. */
+   bool operand_non_void()
+   {
+      return e1->get_void_source()==NEVER_VOID;
+   }
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -847,10 +1174,13 @@ class no_expr_class : public Expression_class {
 protected:
 public:
    no_expr_class() {
+      void_source = MAYBE_VOID;
    }
    Expression copy_Expression();
    Symbol get_expression_type(Class_);
    void dump(ostream& stream, int n);
+   void traverse(tree_visitor, void *);
+   unsigned int compact(CompactAst &);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -868,10 +1198,13 @@ protected:
 public:
    object_class(Symbol a1) {
       name = a1;
+      void_source = MAYBE_VOID;
    }
    Expression copy_Expression();
    Symbol get_expression_type(Class_);
    void dump(ostream& stream, int n);
+   void traverse(tree_visitor, void *);
+   unsigned int compact(CompactAst &);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -930,4 +1263,165 @@ Expression no_expr();
 Expression object(Symbol);
 
 
+// define the compact store (see semant.cc)
+enum compact_kind {
+   PROGRAM_NODE,
+   CLASS_NODE,
+   METHOD_NODE,
+   ATTR_NODE,
+   FORMAL_NODE,
+   BRANCH_NODE,
+   ASSIGN_NODE,
+   STATIC_DISPATCH_NODE,
+   DISPATCH_NODE,
+   COND_NODE,
+   LOOP_NODE,
+   TYPCASE_NODE,
+   BLOCK_NODE,
+   LET_NODE,
+   PLUS_NODE,
+   SUB_NODE,
+   MUL_NODE,
+   DIVIDE_NODE,
+   NEG_NODE,
+   LT_NODE,
+   EQ_NODE,
+   LEQ_NODE,
+   COMP_NODE,
+   INT_CONST_NODE,
+   BOOL_CONST_NODE,
+   STRING_CONST_NODE,
+   NEW_NODE,
+   ISVOID_NODE,
+   NO_EXPR_NODE,
+   OBJECT_NODE,
+   NUM_COMPACT_KINDS
+};
+
+/* the string table a symbol belongs to. */
+enum symbol_table_kind {
+   ID_SYMBOL,
+   INT_SYMBOL,
+   STRING_SYMBOL
+};
+
+struct compact_operands {
+   unsigned int a, b, c, d;
+};
+
+class CompactAst {
+public:
+   std::vector<unsigned char> kinds;
+   std::vector<unsigned int> lines;
+   std::vector<compact_operands> operands;
+   std::vector<unsigned int> types;
+   /* every list is stored as its length followed by its elements. */
+   std::vector<unsigned int> list_items;
+   std::vector<Symbol> symbols;
+   std::vector<unsigned char> symbol_tables;
+   std::map<Symbol, unsigned int> symbol_ids;
+   /* the cool-tree node built for each node by materialize(). */
+   std::vector<tree_node *> materialized;
+
+   /*
+      What semant_compact infers, indexed by node, copied from what the
+      checker stores on each Expression: the void source, the folded constant (valid
+      where `folded' is set), the value of a constant if or while
+      predicate, the only method a monomorphic dispatch can reach, and
+      the branches of each case, most specific first, as a list.
+    */
+   std::vector<int> void_sources;
+   std::vector<int> constants;
+   std::vector<bool> folded;
+   std::map<unsigned int, int> known_preds;
+   std::map<unsigned int, std::pair<Feature, Class_> > targets;
+   std::map<unsigned int, unsigned int> sorted_cases;
+
+   CompactAst();
+
+   unsigned int add_node(compact_kind kind, int line);
+   void set_operands(unsigned int node, unsigned int a, unsigned int b = 0,
+                     unsigned int c = 0, unsigned int d = 0);
+   void set_type(unsigned int node, Symbol type);
+   unsigned int symbol_id(Symbol sym, symbol_table_kind table);
+   template <class Elem> unsigned int add_list(list_node<Elem> *list);
+   unsigned int add_list(const std::vector<unsigned int> &items);
+
+   unsigned int list_length(unsigned int list) { return list_items[list]; }
+   unsigned int list_item(unsigned int list, unsigned int i) { return list_items[list + 1 + i]; }
+   Symbol symbol(unsigned int id) { return symbols[id]; }
+   size_t size() { return kinds.size(); }
+   size_t bytes();
+
+   Program materialize(unsigned int root);
+   void store_annotations();
+
+private:
+   tree_node *built(unsigned int node, tree_node *t);
+   Class_ materialize_class(unsigned int node);
+   Feature materialize_feature(unsigned int node);
+   Formal materialize_formal(unsigned int node);
+   Case materialize_case(unsigned int node);
+   Expression materialize_expression(unsigned int node);
+   Classes materialize_classes(unsigned int list);
+   Features materialize_features(unsigned int list);
+   Formals materialize_formals(unsigned int list);
+   Cases materialize_cases(unsigned int list);
+   Expressions materialize_expressions(unsigned int list);
+};
+
+
+// define the entry points of the semantic analyzer (see semant.cc)
+Program semant_compact(CompactAst &, unsigned int);
+Program semant_streaming(const char *);
+Program read_mapped_ast(const char *);
+bool read_compact_ast(const char *, CompactAst &, unsigned int &);
+bool dump_typed_ast(CompactAst &, unsigned int, ostream &);
+
+// define the binary AST format (see semant.cc)
+bool write_binary_ast(Program, const char *);
+bool write_binary_ast(CompactAst &, unsigned int, const char *);
+bool read_binary_ast(const char *, CompactAst &, unsigned int &);
+Program read_binary_program(const char *);
+
+
+// define the query engine (see semant.cc)
+class ClassTable;
+template <class SYM, class DAT> class ScopedTable;
+
+struct feature_span {
+   int line;
+   Feature feature;
+   Class_ owner;
+};
+
+typedef ScopedTable<Symbol, Symbol> *class_scopes;
+typedef std::vector<std::pair<int, Expression> > located_expressions;
+
+class QueryEngine {
+   ClassTable *table;
+   bool usable;
+   /* per file, every user-defined feature by the line it starts on. */
+   std::map<Symbol, std::vector<feature_span> > spans;
+   std::map<Class_, class_scopes> scopes;
+   std::map<Feature, located_expressions> checked;
+
+   const feature_span *enclosing(Symbol filename, int line);
+   located_expressions &check(const feature_span &span);
+   bool expressions_at(Symbol filename, int line, located_expressions::iterator &first,
+                       located_expressions::iterator &last);
+   void release_scopes();
+public:
+   QueryEngine(Program program);
+   ~QueryEngine();
+
+   /* the type of the outermost expression starting on `line', or NULL. */
+   Symbol type_at(Symbol filename, int line);
+   /* the method the first dispatch starting on `line' resolves to, or NULL. */
+   Feature method_at(Symbol filename, int line, Class_ *defining);
+   /* forgets what was learned about `feature', after it was edited in place. */
+   void invalidate(Feature feature);
+};
+
+
 #endif
@@ -1,12 +1,41 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#if defined(__SSE2__) && !defined(SEMANT_NO_SIMD)
+#define SEMANT_SIMD 1
+#include <emmintrin.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#endif
+#include <algorithm>
+#include <map>
+#include <set>
+#include <vector>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
 #include "semant.h"
 #include "utilities.h"
 
 
 extern int semant_debug;
 extern char *curr_filename;
+extern int node_lineno;
 
 //////////////////////////////////////////////////////////////////////
 //
@@ -36,6 +65,7 @@ static Symbol
     Object,
     out_int,
     out_string,
+    poison,
     prim_slot,
     self,
     SELF_TYPE,
@@ -69,6 +99,10 @@ static void initialize_constants(void)
     Object      = idtable.add_string("Object");
     out_int     = idtable.add_string("out_int");
     out_string  = idtable.add_string("out_string");
+    //   _poison is the type of an expression that failed to check.  It
+    //   is never written into the tree, and nothing checks against it,
+    //   so each error is reported once instead of cascading upwards.
+    poison      = idtable.add_string("_poison");
     prim_slot   = idtable.add_string("_prim_slot");
     self        = idtable.add_string("self");
     SELF_TYPE   = idtable.add_string("SELF_TYPE");
@@ -79,198 +113,1304 @@ static void initialize_constants(void)
     val         = idtable.add_string("_val");
 }
 
-/* symbol tables for semantic checking. */
-SymbolTable<Symbol, Feature> *function_table;
-SymbolTable<Symbol, Symbol> *attribute_table;
+//////////////////////////////////////////////////////////////////////
+//
+// Analyzer statistics
+//
+// When semant_debug is set, or SEMANT_STATS is present in the
+// environment, the analyzer prints a report of the wall time spent in
+// each phase and of the memory held by each of its data structures.
+//
+// With SEMANT_PERF set (Linux only) the report also shows hardware
+// counters for each phase, read through perf_event_open.
+//
+//////////////////////////////////////////////////////////////////////
 
-ClassTable *classtable;
+/* returns true if the analyzer option `name' is set in the environment. */
+static bool semant_option(const char *name)
+{
+    char *value = getenv(name);
+    return value!=NULL && *value!='\0' && strcmp(value,"0")!=0;
+}
 
-/* TO DO - not return after semant_error() */
-ClassTable::ClassTable(Classes classes) : semant_errors(0) , error_stream(cerr) {
+enum semant_phase {
+    CLASS_TABLE_PHASE,
+    SCOPE_PHASE,
+    CHECK_PHASE,
+    ANALYSIS_PHASE,
+    NUM_PHASES
+};
 
-    /* Fill this in */
-    install_basic_classes();
-    
-    int is_Main_present = 0;
-    int is_error = 0;
-    std::map<Symbol, Class_>::iterator it;
-    for(int i=classes->first(); classes->more(i); i=classes->next(i))
-    {
+static const char *phase_names[NUM_PHASES] = {
+    "class table construction",
+    "scope population",
+    "expression checking",
+    "whole-program analysis"
+};
 
-        Class_ current_class = classes->nth(i);
+static double phase_seconds[NUM_PHASES];
+static double phase_started[NUM_PHASES];
 
-        Symbol current_class_name = current_class->get_name();
-        Symbol current_class_parent = current_class->get_parent();
+static double wall_clock()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
 
-        /* checking if the class is not currently present. */
-        it = inheritance_graph.find(current_class_name);
-        if(it!=inheritance_graph.end())
+enum perf_counter {
+    CYCLES_COUNTER,
+    INSTRUCTIONS_COUNTER,
+    CACHE_MISSES_COUNTER,
+    BRANCH_MISSES_COUNTER,
+    NUM_COUNTERS
+};
+
+/* group leader first; -1 while the counters are not in use. */
+static int perf_fds[NUM_COUNTERS] = { -1, -1, -1, -1 };
+static long long phase_counts[NUM_PHASES][NUM_COUNTERS];
+static long long phase_counts_started[NUM_PHASES][NUM_COUNTERS];
+
+static bool perf_counters_open()
+{
+    return perf_fds[CYCLES_COUNTER]!=-1;
+}
+
+static void close_perf_counters()
+{
+    for(int i=NUM_COUNTERS-1; i>=0; i--)
+    {
+#ifdef __linux__
+        if(perf_fds[i]!=-1)
+            close(perf_fds[i]);
+#endif
+        perf_fds[i] = -1;
+    }
+}
+
+/*
+   Opens the four counters as one group so they are scheduled together.
+   If the kernel refuses any of them (no PMU, perf_event_paranoid, not
+   Linux) the report is printed without counters.
+ */
+static void open_perf_counters()
+{
+#ifdef __linux__
+    static const unsigned long long configs[NUM_COUNTERS] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES
+    };
+    for(int i=0; i<NUM_COUNTERS; i++)
+    {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = configs[i];
+        attr.disabled = (i==CYCLES_COUNTER);
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP;
+        int fd = syscall(__NR_perf_event_open, &attr, 0, -1, perf_fds[CYCLES_COUNTER], 0);
+        if(fd==-1)
         {
-            semant_error(current_class)<<"Class "<<current_class_name<<" was previously defined.\n";
+            close_perf_counters();
+            return;
         }
+        perf_fds[i] = fd;
+    }
+    ioctl(perf_fds[CYCLES_COUNTER], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(perf_fds[CYCLES_COUNTER], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+}
 
-        /* checking if the class doesnt inherit itself. */
-        if(current_class_name==current_class_parent)
+static void read_perf_counters(long long counts[NUM_COUNTERS])
+{
+#ifdef __linux__
+    /* PERF_FORMAT_GROUP layout: the number of counters, then their values. */
+    unsigned long long buffer[1 + NUM_COUNTERS];
+    if(read(perf_fds[CYCLES_COUNTER], buffer, sizeof(buffer))==(ssize_t) sizeof(buffer))
+    {
+        for(int i=0; i<NUM_COUNTERS; i++)
+            counts[i] = buffer[1 + i];
+        return;
+    }
+#endif
+    for(int i=0; i<NUM_COUNTERS; i++)
+        counts[i] = 0;
+}
+
+static void phase_begin(semant_phase phase)
+{
+    if(perf_counters_open())
+        read_perf_counters(phase_counts_started[phase]);
+    phase_started[phase] = wall_clock();
+}
+
+static void phase_end(semant_phase phase)
+{
+    phase_seconds[phase] += wall_clock() - phase_started[phase];
+    if(perf_counters_open())
+    {
+        long long counts[NUM_COUNTERS];
+        read_perf_counters(counts);
+        for(int i=0; i<NUM_COUNTERS; i++)
+            phase_counts[phase][i] += counts[i] - phase_counts_started[phase][i];
+    }
+}
+
+/* what one of the scoped symbol tables has allocated, and the most it held at once. */
+struct scope_memory {
+    long frames;
+    long entries;
+    long payloads;
+    long payload_bytes;
+    long live_bytes;
+    long peak_bytes;
+};
+
+static scope_memory attribute_scope_memory;
+
+/*
+   A scoped symbol table that owns the payloads added to it.  Scopes are
+   kept as one stack of entries with the index where each scope starts,
+   so exitscope pops the scope's entries and deletes their payloads, and
+   nothing a method, let or case branch binds outlives it.  The stacks
+   keep their capacity from one class to the next unless release() is
+   called.  Lookups search the stack from the top, as SymbolTable
+   searches its lists.
+ */
+template <class SYM, class DAT>
+class ScopedTable
+{
+    struct entry {
+        SYM id;
+        DAT *info;
+    };
+    std::vector<entry> entries;
+    std::vector<size_t> scope_starts;
+    scope_memory *memory;
+    long accounted;       /* this table's share of memory->live_bytes */
+
+    void account()
+    {
+        long live = bytes() + entries.size() * sizeof(DAT);
+        memory->live_bytes += live - accounted;
+        accounted = live;
+        if(memory->live_bytes > memory->peak_bytes)
+            memory->peak_bytes = memory->live_bytes;
+    }
+public:
+    ScopedTable(scope_memory *m) : memory(m), accounted(0) { }
+    ~ScopedTable() { release(); }
+
+    void enterscope()
+    {
+        memory->frames++;
+        scope_starts.push_back(entries.size());
+        account();
+    }
+
+    void exitscope()
+    {
+        if(scope_starts.empty())
         {
-            semant_error(current_class)<<"Class "<<current_class_name<<", or an ancestor of "<<current_class_name<<", is involved in an inheritance cycle"<<endl;
+            cerr << "exitscope: Can't remove scope from an empty symbol table." << endl;
+            exit(1);
         }
+        for(size_t i=scope_starts.back(); i<entries.size(); i++)
+            delete entries[i].info;
+        entries.resize(scope_starts.back());
+        scope_starts.pop_back();
+        account();
+    }
 
-        else if(current_class_name==SELF_TYPE)
+    void addid(SYM s, DAT *i)
+    {
+        memory->entries++;
+        memory->payloads++;
+        memory->payload_bytes += sizeof(DAT);
+        entry e = { s, i };
+        entries.push_back(e);
+        account();
+    }
+
+    DAT *lookup(SYM s)
+    {
+        for(size_t i=entries.size(); i>0; i--)
         {
-            semant_error(current_class)<<"Redifination of basic class SELF_TYPE\n";   
+            if(entries[i-1].id==s)
+                return entries[i-1].info;
         }
+        return NULL;
+    }
 
-        /* checking if the class doesn't inherit the basic types. */
-        else if(current_class_parent==Bool || current_class_parent==Int || current_class_parent==Str || current_class_parent==SELF_TYPE)
+    DAT *probe(SYM s)
+    {
+        if(scope_starts.empty())
         {
-            semant_error(current_class)<<"Class "<<current_class_name<<" cannot inherit class "<<current_class_parent<<".\n";
+            cerr << "probe: No scope in symbol table." << endl;
+            exit(1);
         }
-
-        /* inserting the current class in the map. */
-        else{
-            inheritance_graph.insert(std::pair<Symbol, Class_>(current_class_name, current_class));
+        for(size_t i=entries.size(); i>scope_starts.back(); i--)
+        {
+            if(entries[i-1].id==s)
+                return entries[i-1].info;
         }
-        
-        /* checking if Main exists. */
-        if(current_class_name==Main)
-            is_Main_present = 1;
+        return NULL;
     }
 
-    /* if Main not found. */
-    if(is_Main_present==0)
+    /* exits every scope. */
+    void clear()
     {
-        semant_error()<<"Class Main is not defined.\n";
+        while(!scope_starts.empty())
+            exitscope();
     }
 
-    /* checking for cycle in the graph. */
-    for(it = inheritance_graph.begin(); it!=inheritance_graph.end(); it++)
+    /* exits every scope and gives the stacks' memory back. */
+    void release()
     {
-        /* checking for cycle from this class as the first class. */
-        bool is_cycle = false;
-        
-        Symbol slow_iterator, fast_iterator;
-        slow_iterator = fast_iterator = it->first;
+        clear();
+        std::vector<entry>().swap(entries);
+        std::vector<size_t>().swap(scope_starts);
+        account();
+    }
 
-        if(slow_iterator==Object)
-            continue;
+    size_t bytes() { return entries.capacity() * sizeof(entry) + scope_starts.capacity() * sizeof(size_t); }
+};
 
-        while(1)
+/* the symbol table for semantic checking; methods are found through each class's feature index. */
+static ScopedTable<Symbol, Symbol> *attribute_table;
+
+ClassTable *classtable;
+
+//////////////////////////////////////////////////////////////////////
+//
+// Diagnostics
+//
+// Errors are recorded as small fixed-size records (a code, the location
+// and up to three Symbol arguments) instead of being formatted onto
+// cerr one `<<' at a time.  The records are turned into text only when
+// flush_diagnostics() writes the pending batch out in a single write,
+// either in the usual "file:line: message" form or, with
+// SEMANT_DIAGNOSTICS=json, as one JSON object per line.
+// SEMANT_MAX_ERRORS=n stops the analysis once n errors are recorded.
+//
+//////////////////////////////////////////////////////////////////////
+
+enum diagnostic_code {
+    CLASS_REDEFINED_ERROR,
+    INHERITANCE_CYCLE_ERROR,
+    SELF_TYPE_REDEFINED_ERROR,
+    BASIC_PARENT_ERROR,
+    MAIN_UNDEFINED_ERROR,
+    UNDEFINED_PARENT_ERROR,
+    UNDECLARED_ASSIGN_ERROR,
+    ASSIGN_CONFORMANCE_ERROR,
+    STATIC_DISPATCH_CLASS_ERROR,
+    STATIC_DISPATCH_CONFORMANCE_ERROR,
+    STATIC_DISPATCH_METHOD_ERROR,
+    ACTUALS_COUNT_ERROR,
+    ACTUALS_CONFORMANCE_ERROR,
+    DISPATCH_CLASS_ERROR,
+    DISPATCH_METHOD_ERROR,
+    LOOP_PREDICATE_ERROR,
+    PLUS_OPERAND_ERROR,
+    SUB_OPERAND_ERROR,
+    MUL_OPERAND_ERROR,
+    DIVIDE_OPERAND_ERROR,
+    NEG_OPERAND_ERROR,
+    LT_OPERAND_ERROR,
+    EQ_OPERAND_ERROR,
+    LEQ_OPERAND_ERROR,
+    COMP_OPERAND_ERROR,
+    NEW_CLASS_ERROR,
+    UNDEFINED_IDENTIFIER_ERROR,
+    SELF_FORMAL_ERROR,
+    FORMAL_TYPE_ERROR,
+    FORMAL_REDEFINED_ERROR,
+    RETURN_TYPE_ERROR,
+    ATTR_TYPE_ERROR,
+    ATTR_INIT_ERROR,
+    METHOD_REDEFINED_ERROR,
+    OVERRIDE_FORMALS_COUNT_ERROR,
+    OVERRIDE_FORMAL_TYPE_ERROR,
+    OVERRIDE_RETURN_TYPE_ERROR,
+    ATTR_REDEFINED_ERROR,
+    INHERITED_ATTR_ERROR,
+    SELF_ATTR_ERROR,
+    CASE_BRANCH_CLASS_ERROR,
+    CASE_SELF_TYPE_ERROR,
+    CASE_SELF_ERROR,
+    CASE_DUPLICATE_ERROR,
+    COND_PREDICATE_ERROR,
+    CLASS_REDEFINED_IN_FILE_ERROR,
+    LET_SELF_ERROR,
+    LET_TYPE_ERROR,
+    LET_INIT_ERROR,
+    /* warnings from here on; they do not stop compilation. */
+    DIVISION_BY_ZERO_WARNING,
+    INT_RANGE_WARNING,
+    NUM_DIAGNOSTIC_CODES
+};
+
+/* the JSON name and message text of each code; each `%' takes the next argument. */
+static const char *diagnostic_formats[NUM_DIAGNOSTIC_CODES][2] = {
+    { "class-redefined", "Class % was previously defined." },
+    { "inheritance-cycle", "Class %, or an ancestor of %, is involved in an inheritance cycle" },
+    { "self-type-redefined", "Redifination of basic class SELF_TYPE" },
+    { "basic-parent", "Class % cannot inherit class %." },
+    { "main-undefined", "Class Main is not defined." },
+    { "undefined-parent", "Class % inherits from an undefined class %." },
+    { "undeclared-assign", "Assignment to undeclared variable %." },
+    { "assign-conformance", "Type % of assigned expression does not conform to declared type % of identifier %." },
+    { "static-dispatch-class", "Class % is undefined" },
+    { "static-dispatch-conformance", "Expression type % is not of inherited from class%" },
+    { "static-dispatch-method", "Method % is undefined" },
+    { "actuals-count", "Lenght of Actuals is not equal to the formals" },
+    { "actuals-conformance", "Actuals does not conforms with the Formals" },
+    { "dispatch-class", "Class % is undefined." },
+    { "dispatch-method", "Method % is undefined." },
+    { "loop-predicate", "Loop condition does not have type Bool." },
+    { "plus-operand", "non-Int arguments: % + %." },
+    { "sub-operand", "non-Int arguments: % - %." },
+    { "mul-operand", "non-Int arguments: % * %." },
+    { "divide-operand", "non-Int arguments: % / %." },
+    { "neg-operand", "Argument of '~' has type % instead of Int." },
+    { "lt-operand", "non-Int arguments: % < %" },
+    { "eq-operand", "Invalid comparison between two classes" },
+    { "leq-operand", "non-Int arguments: % <= %" },
+    { "comp-operand", "Argument of 'not' has type %." },
+    { "new-class", "'new' used with undefined class %" },
+    { "undefined-identifier", "Undefined identifier %" },
+    { "self-formal", "'self' cannot be a formal parameter" },
+    { "formal-type", "Class % of formal parameter % is undefined" },
+    { "formal-redefined", "Formal parameter % is multiply defined" },
+    { "return-type", "Inferred return type % of method % does not conform to declared type %." },
+    { "attr-type", "Class % of attribute % is undefined" },
+    { "attr-init", "Inferred type % of initialization of attribute % does not conform to declared type %." },
+    { "method-redefined", "Method % is multiply defined." },
+    { "override-formals-count", "Incompatible number of formal parameters in redefined method %." },
+    { "override-formal-type", "In redefined method %, parameter type % is different from original type %." },
+    { "override-return-type", "In redefined method %, return type % is different from original return type %." },
+    { "attr-redefined", "Attribute % is multiply defined in class." },
+    { "inherited-attr", "Attribute % is an attribute of an inherited class." },
+    { "self-attr", "'self' cannot be the name of an attribute." },
+    { "case-branch-class", "Class % of case branch is undefined." },
+    { "case-self-type", "Identifier % declared with type SELF_TYPE in case branch." },
+    { "case-self", "'self' bound in 'case'." },
+    { "case-duplicate", "Duplicate branch % in case statement." },
+    { "cond-predicate", "Predicate of 'if' does not have type Bool." },
+    { "class-redefined-in-file", "Class % was previously defined in %." },
+    { "let-self", "'self' cannot be bound in a 'let' expression." },
+    { "let-type", "Class % of let-bound identifier % is undefined." },
+    { "let-init", "Inferred type % of initialization of % does not conform to identifier's declared type %." },
+    { "division-by-zero", "Division by constant zero." },
+    { "int-range", "Integer literal % does not fit in 32 bits." }
+};
+
+struct diagnostic {
+    int code;
+    int line;
+    Symbol filename;      /* NULL when the error has no location */
+    Symbol args[3];
+};
+
+static bool is_warning(int code)
+{
+    return code>=DIVISION_BY_ZERO_WARNING;
+}
+
+/* every error and warning recorded so far, and how many of them have been written out. */
+static std::vector<diagnostic> diagnostics;
+static size_t diagnostics_flushed = 0;
+
+/* while set, the diagnostic limit is not enforced; see semant_streaming. */
+static bool speculative_diagnostics = false;
+
+/* SEMANT_MAX_ERRORS; 0, after a warning, if it is not a number. */
+static size_t diagnostic_limit()
+{
+    char *value = getenv("SEMANT_MAX_ERRORS");
+    if(value==NULL || *value=='\0')
+        return 0;
+    char *end;
+    errno = 0;
+    unsigned long limit = strtoul(value, &end, 10);
+    if(!isdigit((unsigned char) value[0]) || *end!='\0' || errno==ERANGE)
+    {
+        cerr << "Ignoring SEMANT_MAX_ERRORS=" << value << ": not a number of errors." << endl;
+        return 0;
+    }
+    return limit;
+}
+
+static void append_json_string(std::string &out, const char *s, int length)
+{
+    out += '"';
+    for(int i=0; i<length; i++)
+    {
+        unsigned char c = s[i];
+        if(c=='"' || c=='\\')
         {
-            if(inheritance_graph.find(inheritance_graph.find(slow_iterator)->second->get_parent())==inheritance_graph.end())
-            {
-                semant_error(inheritance_graph.find(slow_iterator)->second)<<"Class "<<slow_iterator<<" inherits from an undefined class "<<inheritance_graph.find(slow_iterator)->second->get_parent()<<".\n";
-                return;
-            }
-            slow_iterator = inheritance_graph.find(slow_iterator)->second->get_parent();
-            
-            if(inheritance_graph.find(inheritance_graph.find(fast_iterator)->second->get_parent())==inheritance_graph.end())
-            {
-                semant_error(inheritance_graph.find(fast_iterator)->second)<<"Class "<<fast_iterator<<" inherits from an undefined class "<<inheritance_graph.find(fast_iterator)->second->get_parent()<<".\n";
-                return;
-            }
-            fast_iterator = inheritance_graph.find(fast_iterator)->second->get_parent();
-            if(fast_iterator!=Object)
-            {
-                if(inheritance_graph.find(inheritance_graph.find(fast_iterator)->second->get_parent())==inheritance_graph.end())
-                {
-                    semant_error(inheritance_graph.find(fast_iterator)->second)<<"Class "<<fast_iterator<<" inherits from an undefined class "<<inheritance_graph.find(fast_iterator)->second->get_parent()<<".\n";
-                    return;
-                }
-                fast_iterator = inheritance_graph.find(fast_iterator)->second->get_parent();
-            }
+            out += '\\';
+            out += c;
+        }
+        else if(c<0x20)
+        {
+            char escape[8];
+            snprintf(escape, sizeof(escape), "\\u%04x", c);
+            out += escape;
+        }
+        else
+            out += c;
+    }
+    out += '"';
+}
 
-            if(slow_iterator==Object || fast_iterator==Object)
-                break;
+static void format_message(std::string &out, const diagnostic &d)
+{
+    const char *text = diagnostic_formats[d.code][1];
+    int arg = 0;
+    for(const char *p = text; *p; p++)
+    {
+        if(*p=='%' && arg<3 && d.args[arg]!=NULL)
+        {
+            Symbol sym = d.args[arg++];
+            out.append(sym->get_string(), sym->get_len());
+        }
+        else
+            out += *p;
+    }
+}
 
-            if(slow_iterator==fast_iterator)
+/* formats every pending diagnostic and writes the batch to stderr at once. */
+void flush_diagnostics()
+{
+    static int json = -1;
+    if(json==-1)
+    {
+        char *value = getenv("SEMANT_DIAGNOSTICS");
+        json = value!=NULL && strcmp(value, "json")==0;
+    }
+
+    std::string out;
+    out.reserve((diagnostics.size() - diagnostics_flushed) * 96);
+    for(size_t i=diagnostics_flushed; i<diagnostics.size(); i++)
+    {
+        const diagnostic &d = diagnostics[i];
+        if(json)
+        {
+            std::string message;
+            format_message(message, d);
+            out += "{\"code\":\"";
+            out += diagnostic_formats[d.code][0];
+            out += is_warning(d.code) ? "\",\"severity\":\"warning\"" : "\",\"severity\":\"error\"";
+            if(d.filename)
             {
-                is_cycle = true;
-                break;
+                char line[16];
+                snprintf(line, sizeof(line), "%d", d.line);
+                out += ",\"file\":";
+                append_json_string(out, d.filename->get_string(), d.filename->get_len());
+                out += ",\"line\":";
+                out += line;
             }
+            out += ",\"message\":";
+            append_json_string(out, message.data(), message.size());
+            out += "}\n";
         }
-
-        if(is_cycle)
+        else
         {
-            semant_error(it->second)<<"Class "<<it->first<<", or an ancestor of "<<it->first<<", is involved in an inheritance cycle"<<endl;
+            if(d.filename)
+            {
+                char line[16];
+                snprintf(line, sizeof(line), ":%d: ", d.line);
+                out.append(d.filename->get_string(), d.filename->get_len());
+                out += line;
+            }
+            if(is_warning(d.code))
+                out += "warning: ";
+            format_message(out, d);
+            out += '\n';
         }
     }
+    diagnostics_flushed = diagnostics.size();
+    cerr.flush();
+    fwrite(out.data(), 1, out.size(), stderr);
+    fflush(stderr);
+}
 
+static void record_diagnostic(Class_ c, diagnostic_code code, Symbol a, Symbol b, Symbol d)
+{
+    diagnostic record;
+    record.code = code;
+    record.filename = c ? c->get_filename() : NULL;
+    record.line = c ? c->get_line_number() : 0;
+    record.args[0] = a;
+    record.args[1] = b;
+    record.args[2] = d;
+    diagnostics.push_back(record);
 }
-void ClassTable::install_basic_classes() {
 
-    // The tree package uses these globals to annotate the classes built below.
-   // curr_lineno  = 0;
-    Symbol filename = stringtable.add_string("<basic class>");
-    
-    // The following demonstrates how to create dummy parse trees to
-    // refer to basic Cool classes.  There's no need for method
-    // bodies -- these are already built into the runtime system.
-    
-    // IMPORTANT: The results of the following expressions are
-    // stored in local variables.  You will want to do something
-    // with those variables at the end of this method to make this
-    // code meaningful.
+/*
+   Records an error at class `c' (or with no location when `c' is
+   NULL) and counts it in `table'.  Once the SEMANT_MAX_ERRORS limit is
+   reached the batch is written out and the analysis stops.
+ */
+void diagnose(ClassTable *table, Class_ c, diagnostic_code code, Symbol a = NULL, Symbol b = NULL, Symbol d = NULL)
+{
+    static size_t limit = diagnostic_limit();
+    record_diagnostic(c, code, a, b, d);
+    table->semant_error();
 
-    // 
-    // The Object class has no parent class. Its methods are
-    //        abort() : Object    aborts the program
-    //        type_name() : Str   returns a string representation of class name
-    //        copy() : SELF_TYPE  returns a copy of the object
-    //
-    // There is no need for method bodies in the basic classes---these
-    // are already built in to the runtime system.
+    if(limit>0 && !speculative_diagnostics && (size_t) table->errors()>=limit)
+    {
+        flush_diagnostics();
+        cerr << "Stopped after " << limit << " errors (SEMANT_MAX_ERRORS)." << endl;
+        cerr << "Compilation halted due to static semantic errors." << endl;
+        exit(1);
+    }
+}
 
-    Class_ Object_class =
-    class_(Object, 
-           No_class,
-           append_Features(
-                   append_Features(
-                           single_Features(method(cool_abort, nil_Formals(), Object, no_expr())),
-                           single_Features(method(type_name, nil_Formals(), Str, no_expr()))),
-                   single_Features(method(copy, nil_Formals(), SELF_TYPE, no_expr()))),
-           filename);
+/* records a warning at class `c'; warnings are not counted as errors. */
+void warn(Class_ c, diagnostic_code code, Symbol a = NULL)
+{
+    record_diagnostic(c, code, a, NULL, NULL);
+}
 
-    // 
-    // The IO class inherits from Object. Its methods are
-    //        out_string(Str) : SELF_TYPE       writes a string to the output
-    //        out_int(Int) : SELF_TYPE            "    an int    "  "     "
-    //        in_string() : Str                 reads a string from the input
-    //        in_int() : Int                      "   an int     "  "     "
-    //
-    Class_ IO_class = 
-    class_(IO, 
-           Object,
-           append_Features(
-                   append_Features(
-                           append_Features(
-                                   single_Features(method(out_string, single_Formals(formal(arg, Str)),
-                                              SELF_TYPE, no_expr())),
-                                   single_Features(method(out_int, single_Formals(formal(arg, Int)),
-                                              SELF_TYPE, no_expr()))),
-                           single_Features(method(in_string, nil_Formals(), Str, no_expr()))),
-                   single_Features(method(in_int, nil_Formals(), Int, no_expr()))),
-           filename);  
+//////////////////////////////////////////////////////////////////////
+//
+// Dispatch cache
+//
+// getmethods resolves a method name against a receiver class by
+// walking up the inheritance chain.  The result, together with the
+// class that defines the method, is remembered in a program-wide
+// open-addressing table keyed by (receiver class, method name), so a
+// call site that was resolved before costs one probe.  Misses are
+// cached too.  Lookups share a read lock; a miss resolves outside the
+// lock and inserts under the write lock.  The table is emptied whenever
+// a ClassTable rebuilds the inheritance graph.
+//
+//////////////////////////////////////////////////////////////////////
 
-    //
-    // The Int class has no methods and only a single attribute, the
-    // "val" for the integer. 
-    //
-    Class_ Int_class =
-    class_(Int, 
-           Object,
-           single_Features(attr(val, prim_slot, no_expr())),
-           filename);
+struct dispatch_entry {
+    Class_ receiver;      /* NULL for an empty slot */
+    Symbol name;
+    Feature feature;      /* NULL when the class has no such method */
+    Class_ defining;
+};
 
-    //
-    // Bool also has only the "val" slot.
-    //
-    Class_ Bool_class =
-    class_(Bool, Object, single_Features(attr(val, prim_slot, no_expr())),filename);
+class DispatchCache {
+public:
+    DispatchCache();
+    ~DispatchCache();
 
-    //
-    // The class Str has a number of slots and operations:
-    //       val                                  the length of the string
-    //       str_field                            the string itself
+    bool lookup(Class_ receiver, Symbol name, dispatch_entry &result);
+    void insert(const dispatch_entry &entry);
+    void clear();
+    size_t size() { return used; }
+    size_t bytes() { return slots.size() * sizeof(dispatch_entry); }
+
+private:
+    std::vector<dispatch_entry> slots;
+    size_t used;
+    pthread_rwlock_t lock;
+
+    static size_t hash(Class_ receiver, Symbol name)
+    {
+        size_t h = ((size_t) receiver >> 3) * 31 + ((size_t) name >> 3);
+        return h * 2654435761u;
+    }
+    void place(const dispatch_entry &entry);
+};
+
+static const size_t dispatch_cache_initial_slots = 1024;
+
+DispatchCache::DispatchCache() : used(0)
+{
+    dispatch_entry empty = { NULL, NULL, NULL, NULL };
+    slots.assign(dispatch_cache_initial_slots, empty);
+    pthread_rwlock_init(&lock, NULL);
+}
+
+DispatchCache::~DispatchCache()
+{
+    pthread_rwlock_destroy(&lock);
+}
+
+bool DispatchCache::lookup(Class_ receiver, Symbol name, dispatch_entry &result)
+{
+    pthread_rwlock_rdlock(&lock);
+    size_t mask = slots.size() - 1;
+    bool found = false;
+    for(size_t i = hash(receiver, name) & mask; slots[i].receiver!=NULL; i = (i + 1) & mask)
+    {
+        if(slots[i].receiver==receiver && slots[i].name==name)
+        {
+            result = slots[i];
+            found = true;
+            break;
+        }
+    }
+    pthread_rwlock_unlock(&lock);
+    return found;
+}
+
+/* puts `entry' in its slot; the caller holds the write lock and has made room. */
+void DispatchCache::place(const dispatch_entry &entry)
+{
+    size_t mask = slots.size() - 1;
+    size_t i = hash(entry.receiver, entry.name) & mask;
+    while(slots[i].receiver!=NULL)
+    {
+        if(slots[i].receiver==entry.receiver && slots[i].name==entry.name)
+            return;
+        i = (i + 1) & mask;
+    }
+    slots[i] = entry;
+    used++;
+}
+
+void DispatchCache::insert(const dispatch_entry &entry)
+{
+    pthread_rwlock_wrlock(&lock);
+    if((used + 1) * 2 > slots.size())
+    {
+        std::vector<dispatch_entry> old;
+        old.swap(slots);
+        dispatch_entry empty = { NULL, NULL, NULL, NULL };
+        slots.assign(old.size() * 2, empty);
+        used = 0;
+        for(size_t j=0; j<old.size(); j++)
+        {
+            if(old[j].receiver!=NULL)
+                place(old[j]);
+        }
+    }
+    place(entry);
+    pthread_rwlock_unlock(&lock);
+}
+
+void DispatchCache::clear()
+{
+    pthread_rwlock_wrlock(&lock);
+    dispatch_entry empty = { NULL, NULL, NULL, NULL };
+    std::vector<dispatch_entry>(dispatch_cache_initial_slots, empty).swap(slots);
+    used = 0;
+    pthread_rwlock_unlock(&lock);
+}
+
+static DispatchCache dispatch_cache;
+
+//////////////////////////////////////////////////////////////////////
+//
+// Feature index
+//
+// Every class keeps a small open-addressed table from feature name to
+// the first method and the first attribute of that name it defines,
+// so looking a feature up in one class does not walk its Features.  A
+// feature that is not the one its class's index holds for its name is
+// a duplicate.  The index is built for every class in the graph when
+// the class table is built, and on first use for any other class.
+//
+// The class table then checks the declarations of each class's own
+// features once: duplicates against the index, overrides and
+// attribute redefinitions against the ancestors.  The errors are kept
+// until check_class reports them for that class, and the attributes
+// they reject are left out of the scopes.
+//
+//////////////////////////////////////////////////////////////////////
+
+struct feature_slot {
+    Symbol name;
+    Feature method;
+    Feature attr;
+};
+
+/* the classes indexed so far, and the memory their indexes take. */
+static long indexed_classes = 0;
+static long feature_index_bytes = 0;
+
+static unsigned int feature_hash(Symbol name)
+{
+    return ((size_t) name >> 3) * 2654435761u;
+}
+
+void class__class::index_features()
+{
+    if(feature_slots!=NULL)
+        return;
+    unsigned int slots = 4;
+    while(slots < 2 * (unsigned int) features->len())
+        slots *= 2;
+    feature_slots = new feature_slot[slots];
+    feature_mask = slots - 1;
+    feature_slot empty = { NULL, NULL, NULL };
+    for(unsigned int i=0; i<slots; i++)
+        feature_slots[i] = empty;
+
+    for(int i=features->first(); features->more(i); i=features->next(i))
+    {
+        Feature feature = features->nth(i);
+        Symbol feature_name = feature->get_name();
+        unsigned int j = feature_hash(feature_name) & feature_mask;
+        while(feature_slots[j].name!=NULL && feature_slots[j].name!=feature_name)
+            j = (j + 1) & feature_mask;
+        feature_slots[j].name = feature_name;
+        if(feature->get_formals()!=NULL)
+        {
+            if(feature_slots[j].method==NULL)
+                feature_slots[j].method = feature;
+        }
+        else if(feature_slots[j].attr==NULL)
+            feature_slots[j].attr = feature;
+    }
+    indexed_classes++;
+    feature_index_bytes += slots * sizeof(feature_slot);
+}
+
+Feature class__class::find_method(Symbol method_name)
+{
+    index_features();
+    unsigned int j = feature_hash(method_name) & feature_mask;
+    for(; feature_slots[j].name!=NULL; j = (j + 1) & feature_mask)
+    {
+        if(feature_slots[j].name==method_name)
+            return feature_slots[j].method;
+    }
+    return NULL;
+}
+
+Feature class__class::find_attr(Symbol attr_name)
+{
+    index_features();
+    unsigned int j = feature_hash(attr_name) & feature_mask;
+    for(; feature_slots[j].name!=NULL; j = (j + 1) & feature_mask)
+    {
+        if(feature_slots[j].name==attr_name)
+            return feature_slots[j].attr;
+    }
+    return NULL;
+}
+
+static void index_class_features()
+{
+    std::map<Symbol, Class_>::iterator it;
+    for(it = inheritance_graph.begin(); it!=inheritance_graph.end(); it++)
+        it->second->index_features();
+}
+
+struct declaration_error {
+    diagnostic_code code;
+    Symbol args[3];
+};
+
+/* each class's declaration errors, until check_class reports them, and the attributes they reject. */
+static std::map<Class_, std::vector<declaration_error> > declaration_errors;
+static std::set<Feature> rejected_attrs;
+
+static void declaration_error_in(Class_ c, diagnostic_code code, Symbol a = NULL, Symbol b = NULL, Symbol d = NULL)
+{
+    declaration_error error = { code, { a, b, d } };
+    declaration_errors[c].push_back(error);
+}
+
+/* checks the declarations of the features `c' defines; its ancestors must be in the graph. */
+static void check_declarations(Class_ c)
+{
+    Features features = c->get_features();
+    for(int i=features->first(); features->more(i); i=features->next(i))
+        features->nth(i)->check_declaration(c);
+}
+
+static void check_class_declarations(Classes classes)
+{
+    for(int i=classes->first(); classes->more(i); i=classes->next(i))
+    {
+        Class_ c = classes->nth(i);
+        std::map<Symbol, Class_>::iterator it = inheritance_graph.find(c->get_name());
+        if(it!=inheritance_graph.end() && it->second==c)
+            check_declarations(c);
+    }
+}
+
+static void report_declaration_errors(Class_ c)
+{
+    std::map<Class_, std::vector<declaration_error> >::iterator found = declaration_errors.find(c);
+    if(found==declaration_errors.end())
+        return;
+    for(size_t i=0; i<found->second.size(); i++)
+    {
+        declaration_error &error = found->second[i];
+        diagnose(classtable, c, error.code, error.args[0], error.args[1], error.args[2]);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// Method signatures
+//
+// Every method's signature -- its formal types followed by its return
+// type -- is interned into a small integer id when the class table is
+// built, so an override check is one integer compare in the common
+// case.  The types of all signatures sit back to back in
+// signature_types, which dispatch checking indexes directly instead of
+// walking Formals.  Methods of classes that were not in the table when
+// it was built are interned the first time they are asked for.
+//
+//////////////////////////////////////////////////////////////////////
+
+struct method_signature {
+    unsigned int offset;  /* index of the first formal type in signature_types */
+    unsigned int arity;   /* the return type follows the formals */
+};
+
+static std::vector<Symbol> signature_types;
+static std::vector<method_signature> signatures;
+static std::map<std::vector<Symbol>, int> signature_ids;
+
+static int intern_signature(Feature method)
+{
+    int id = method->get_signature();
+    if(id>=0)
+        return id;
+
+    Formals formals = method->get_formals();
+    std::vector<Symbol> key;
+    for(int i=formals->first(); formals->more(i); i=formals->next(i))
+        key.push_back(formals->nth(i)->get_type());
+    key.push_back(method->get_return_type());
+
+    std::map<std::vector<Symbol>, int>::iterator it = signature_ids.find(key);
+    if(it!=signature_ids.end())
+        id = it->second;
+    else
+    {
+        method_signature signature;
+        signature.offset = signature_types.size();
+        signature.arity = key.size() - 1;
+        signature_types.insert(signature_types.end(), key.begin(), key.end());
+        id = signatures.size();
+        signatures.push_back(signature);
+        signature_ids.insert(std::pair<std::vector<Symbol>, int>(key, id));
+    }
+    method->set_signature(id);
+    return id;
+}
+
+/* interns the signature of every method of every class in the inheritance graph. */
+static void intern_class_signatures()
+{
+    std::map<Symbol, Class_>::iterator it;
+    for(it = inheritance_graph.begin(); it!=inheritance_graph.end(); it++)
+    {
+        Features features = it->second->get_features();
+        for(int i=features->first(); features->more(i); i=features->next(i))
+        {
+            if(features->nth(i)->get_formals()!=NULL)
+                intern_signature(features->nth(i));
+        }
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// Class tags
+//
+// When the class table is built, every class reachable from Object is
+// numbered in depth-first preorder, with the basic classes first and
+// the rest in program order.  A class's subclasses then have exactly
+// the tags in [tag, last], so "is X a subclass of Y" is a range check
+// both here and in the generated case dispatch.
+//
+// With at most ancestor_matrix_limit tagged classes, each class also
+// gets a bitset row, indexed by tag, holding the class and its
+// ancestors.  The common ancestors of several classes are the AND of
+// their rows.  They form a chain down from Object, and an ancestor's
+// tag is smaller than its descendants', so the least upper bound is
+// the highest bit left.  A larger hierarchy would need tags^2/8 bytes,
+// so it has no matrix.  It keeps each tag's parent tag and subtree end
+// instead, and the least upper bound is the first ancestor of one of
+// the classes whose subtree range holds all of the others' tags.
+//
+//////////////////////////////////////////////////////////////////////
+
+struct class_tag {
+    int tag;
+    int last;             /* the largest tag in the class's subtree */
+};
+
+static std::map<Symbol, class_tag> class_tags;
+static std::vector<Class_> tagged_classes;   /* tag -> class */
+
+static const size_t ancestor_matrix_limit = 4096;
+static size_t ancestor_words = 0;     /* 64-bit words per row, or 0 without a matrix */
+static std::vector<unsigned long long> ancestor_rows;
+static std::vector<size_t> parent_tags;    /* tag -> parent's tag, without a matrix */
+static std::vector<size_t> subtree_ends;   /* tag -> last tag of its subtree, without a matrix */
+
+static void build_ancestor_matrix()
+{
+    size_t classes = tagged_classes.size();
+    ancestor_words = classes<=ancestor_matrix_limit ? (classes + 63) / 64 : 0;
+    ancestor_rows.assign(classes * ancestor_words, 0);
+    parent_tags.clear();
+    subtree_ends.clear();
+    if(ancestor_words==0)
+    {
+        parent_tags.resize(classes);
+        subtree_ends.resize(classes);
+        for(size_t tag=0; tag<classes; tag++)
+        {
+            Class_ c = tagged_classes[tag];
+            parent_tags[tag] = tag>0 ? class_tags[c->get_parent()].tag : 0;
+            subtree_ends[tag] = class_tags[c->get_name()].last;
+        }
+    }
+    for(size_t tag=0; tag<classes && ancestor_words>0; tag++)
+    {
+        unsigned long long *row = &ancestor_rows[tag * ancestor_words];
+        if(tag>0)
+        {
+            /* preorder tags the parent first, so its row is already complete. */
+            size_t parent = class_tags[tagged_classes[tag]->get_parent()].tag;
+            memcpy(row, &ancestor_rows[parent * ancestor_words], ancestor_words * sizeof(*row));
+        }
+        row[tag / 64] |= 1ULL << (tag % 64);
+    }
+}
+
+/* `into' &= `row' over `words' words. */
+static void and_ancestor_row(unsigned long long *into, const unsigned long long *row, size_t words)
+{
+    size_t w = 0;
+#ifdef SEMANT_SIMD
+#ifdef __AVX2__
+    for(; w+4<=words; w+=4)
+    {
+        __m256i x = _mm256_loadu_si256((const __m256i *) (into + w));
+        __m256i y = _mm256_loadu_si256((const __m256i *) (row + w));
+        _mm256_storeu_si256((__m256i *) (into + w), _mm256_and_si256(x, y));
+    }
+#endif
+    for(; w+2<=words; w+=2)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *) (into + w));
+        __m128i y = _mm_loadu_si128((const __m128i *) (row + w));
+        _mm_storeu_si128((__m128i *) (into + w), _mm_and_si128(x, y));
+    }
+#endif
+    for(; w<words; w++)
+        into[w] &= row[w];
+}
+
+/* the join of `count' tags from the subtree ranges, for a hierarchy too large for the matrix. */
+static size_t join_ancestor_ranges(const std::vector<size_t> &tags, size_t count)
+{
+    size_t common = tags[0];
+    for(size_t i=1; i<count; i++)
+    {
+        /* Object's range holds every tag, so the walk ends there at the latest. */
+        while(tags[i] < common || tags[i] > subtree_ends[common])
+            common = parent_tags[common];
+    }
+    return common;
+}
+
+/*
+   The least upper bound of the `count' class names at `types', none of
+   them SELF_TYPE, from the ancestor matrix or the subtree ranges.
+   False if there are no classes or one of them has no tag.
+ */
+static bool join_ancestors(const Symbol *types, size_t count, Symbol &result)
+{
+    if(count==0)
+        return false;
+    std::vector<size_t> tags(count);
+    size_t lowest = tagged_classes.size();
+    for(size_t i=0; i<count; i++)
+    {
+        std::map<Symbol, class_tag>::iterator found = class_tags.find(types[i]);
+        if(found==class_tags.end())
+            return false;
+        tags[i] = found->second.tag;
+        lowest = std::min(lowest, tags[i]);
+    }
+    if(ancestor_words==0)
+    {
+        result = tagged_classes[join_ancestor_ranges(tags, count)]->get_name();
+        return true;
+    }
+
+    /* no common ancestor can have a larger tag than the smallest one here. */
+    size_t words = lowest / 64 + 1;
+    std::vector<unsigned long long> common(ancestor_rows.begin() + tags[0] * ancestor_words,
+                                           ancestor_rows.begin() + tags[0] * ancestor_words + words);
+    for(size_t i=1; i<count; i++)
+        and_ancestor_row(&common[0], &ancestor_rows[tags[i] * ancestor_words], words);
+    for(size_t w=words; w-->0; )
+    {
+        if(common[w]!=0)
+        {
+            result = tagged_classes[w * 64 + 63 - __builtin_clzll(common[w])]->get_name();
+            return true;
+        }
+    }
+    return false;
+}
+
+static void assign_class_tags(Classes classes)
+{
+    class_tags.clear();
+    tagged_classes.clear();
+
+    std::map<Symbol, std::vector<Class_> > children;
+    Symbol basic[] = { IO, Int, Bool, Str };
+    for(size_t i=0; i<sizeof(basic)/sizeof(basic[0]); i++)
+        children[Object].push_back(inheritance_graph.find(basic[i])->second);
+    for(int i=classes->first(); classes->more(i); i=classes->next(i))
+    {
+        Class_ c = classes->nth(i);
+        std::map<Symbol, Class_>::iterator it = inheritance_graph.find(c->get_name());
+        if(it!=inheritance_graph.end() && it->second==c)
+            children[c->get_parent()].push_back(c);
+    }
+
+    /* (class, index of its next child) for each class on the current path. */
+    std::vector<std::pair<Symbol, size_t> > path;
+    class_tag root = { 0, 0 };
+    class_tags[Object] = root;
+    tagged_classes.push_back(inheritance_graph.find(Object)->second);
+    path.push_back(std::pair<Symbol, size_t>(Object, 0));
+    while(!path.empty())
+    {
+        Symbol current = path.back().first;
+        std::vector<Class_> &below = children[current];
+        if(path.back().second < below.size())
+        {
+            Class_ child = below[path.back().second++];
+            class_tag tag = { (int) tagged_classes.size(), 0 };
+            class_tags[child->get_name()] = tag;
+            tagged_classes.push_back(child);
+            path.push_back(std::pair<Symbol, size_t>(child->get_name(), 0));
+        }
+        else
+        {
+            class_tags[current].last = tagged_classes.size() - 1;
+            path.pop_back();
+        }
+    }
+    build_ancestor_matrix();
+}
+
+/*
+   Filled in by read_mapped_asts: for each class that redefines a class
+   first defined in another input file, the file of that first definition.
+ */
+static std::map<Class_, Symbol> earlier_definition_files;
+
+/* TO DO - not return after semant_error() */
+ClassTable::ClassTable(Classes classes) : semant_errors(0) , error_stream(cerr) {
+
+    /* Fill this in */
+    dispatch_cache.clear();
+    class_tags.clear();
+    declaration_errors.clear();
+    rejected_attrs.clear();
+    install_basic_classes();
+    
+    int is_Main_present = 0;
+    int is_error = 0;
+    std::map<Symbol, Class_>::iterator it;
+    for(int i=classes->first(); classes->more(i); i=classes->next(i))
+    {
+
+        Class_ current_class = classes->nth(i);
+
+        Symbol current_class_name = current_class->get_name();
+        Symbol current_class_parent = current_class->get_parent();
+
+        /* checking if the class is not currently present. */
+        it = inheritance_graph.find(current_class_name);
+        if(it!=inheritance_graph.end())
+        {
+            std::map<Class_, Symbol>::iterator earlier = earlier_definition_files.find(current_class);
+            if(earlier!=earlier_definition_files.end())
+                diagnose(this, current_class, CLASS_REDEFINED_IN_FILE_ERROR, current_class_name, earlier->second);
+            else
+                diagnose(this, current_class, CLASS_REDEFINED_ERROR, current_class_name);
+        }
+
+        /* checking if the class doesnt inherit itself. */
+        if(current_class_name==current_class_parent)
+        {
+            diagnose(this, current_class, INHERITANCE_CYCLE_ERROR, current_class_name, current_class_name);
+        }
+
+        else if(current_class_name==SELF_TYPE)
+        {
+            diagnose(this, current_class, SELF_TYPE_REDEFINED_ERROR);
+        }
+
+        /* checking if the class doesn't inherit the basic types. */
+        else if(current_class_parent==Bool || current_class_parent==Int || current_class_parent==Str || current_class_parent==SELF_TYPE)
+        {
+            diagnose(this, current_class, BASIC_PARENT_ERROR, current_class_name, current_class_parent);
+        }
+
+        /* inserting the current class in the map. */
+        else{
+            inheritance_graph.insert(std::pair<Symbol, Class_>(current_class_name, current_class));
+        }
+        
+        /* checking if Main exists. */
+        if(current_class_name==Main)
+            is_Main_present = 1;
+    }
+
+    /* if Main not found. */
+    if(is_Main_present==0)
+    {
+        diagnose(this, NULL, MAIN_UNDEFINED_ERROR);
+    }
+
+    /* checking for cycle in the graph. */
+    for(it = inheritance_graph.begin(); it!=inheritance_graph.end(); it++)
+    {
+        /* checking for cycle from this class as the first class. */
+        bool is_cycle = false;
+        
+        Symbol slow_iterator, fast_iterator;
+        slow_iterator = fast_iterator = it->first;
+
+        if(slow_iterator==Object)
+            continue;
+
+        while(1)
+        {
+            if(inheritance_graph.find(inheritance_graph.find(slow_iterator)->second->get_parent())==inheritance_graph.end())
+            {
+                diagnose(this, inheritance_graph.find(slow_iterator)->second, UNDEFINED_PARENT_ERROR, slow_iterator, inheritance_graph.find(slow_iterator)->second->get_parent());
+                return;
+            }
+            slow_iterator = inheritance_graph.find(slow_iterator)->second->get_parent();
+            
+            if(inheritance_graph.find(inheritance_graph.find(fast_iterator)->second->get_parent())==inheritance_graph.end())
+            {
+                diagnose(this, inheritance_graph.find(fast_iterator)->second, UNDEFINED_PARENT_ERROR, fast_iterator, inheritance_graph.find(fast_iterator)->second->get_parent());
+                return;
+            }
+            fast_iterator = inheritance_graph.find(fast_iterator)->second->get_parent();
+            if(fast_iterator!=Object)
+            {
+                if(inheritance_graph.find(inheritance_graph.find(fast_iterator)->second->get_parent())==inheritance_graph.end())
+                {
+                    diagnose(this, inheritance_graph.find(fast_iterator)->second, UNDEFINED_PARENT_ERROR, fast_iterator, inheritance_graph.find(fast_iterator)->second->get_parent());
+                    return;
+                }
+                fast_iterator = inheritance_graph.find(fast_iterator)->second->get_parent();
+            }
+
+            if(slow_iterator==Object || fast_iterator==Object)
+                break;
+
+            if(slow_iterator==fast_iterator)
+            {
+                is_cycle = true;
+                break;
+            }
+        }
+
+        if(is_cycle)
+        {
+            diagnose(this, it->second, INHERITANCE_CYCLE_ERROR, it->first, it->first);
+            is_error = 1;
+        }
+    }
+
+    index_class_features();
+    intern_class_signatures();
+    assign_class_tags(classes);
+    if(!is_error)
+        check_class_declarations(classes);
+}
+void ClassTable::install_basic_classes() {
+
+    // The tree package uses these globals to annotate the classes built below.
+   // curr_lineno  = 0;
+    Symbol filename = stringtable.add_string("<basic class>");
+    
+    // The following demonstrates how to create dummy parse trees to
+    // refer to basic Cool classes.  There's no need for method
+    // bodies -- these are already built into the runtime system.
+    
+    // IMPORTANT: The results of the following expressions are
+    // stored in local variables.  You will want to do something
+    // with those variables at the end of this method to make this
+    // code meaningful.
+
+    // 
+    // The Object class has no parent class. Its methods are
+    //        abort() : Object    aborts the program
+    //        type_name() : Str   returns a string representation of class name
+    //        copy() : SELF_TYPE  returns a copy of the object
+    //
+    // There is no need for method bodies in the basic classes---these
+    // are already built in to the runtime system.
+
+    Class_ Object_class =
+    class_(Object, 
+           No_class,
+           append_Features(
+                   append_Features(
+                           single_Features(method(cool_abort, nil_Formals(), Object, no_expr())),
+                           single_Features(method(type_name, nil_Formals(), Str, no_expr()))),
+                   single_Features(method(copy, nil_Formals(), SELF_TYPE, no_expr()))),
+           filename);
+
+    // 
+    // The IO class inherits from Object. Its methods are
+    //        out_string(Str) : SELF_TYPE       writes a string to the output
+    //        out_int(Int) : SELF_TYPE            "    an int    "  "     "
+    //        in_string() : Str                 reads a string from the input
+    //        in_int() : Int                      "   an int     "  "     "
+    //
+    Class_ IO_class = 
+    class_(IO, 
+           Object,
+           append_Features(
+                   append_Features(
+                           append_Features(
+                                   single_Features(method(out_string, single_Formals(formal(arg, Str)),
+                                              SELF_TYPE, no_expr())),
+                                   single_Features(method(out_int, single_Formals(formal(arg, Int)),
+                                              SELF_TYPE, no_expr()))),
+                           single_Features(method(in_string, nil_Formals(), Str, no_expr()))),
+                   single_Features(method(in_int, nil_Formals(), Int, no_expr()))),
+           filename);  
+
+    //
+    // The Int class has no methods and only a single attribute, the
+    // "val" for the integer. 
+    //
+    Class_ Int_class =
+    class_(Int, 
+           Object,
+           single_Features(attr(val, prim_slot, no_expr())),
+           filename);
+
+    //
+    // Bool also has only the "val" slot.
+    //
+    Class_ Bool_class =
+    class_(Bool, Object, single_Features(attr(val, prim_slot, no_expr())),filename);
+
+    //
+    // The class Str has a number of slots and operations:
+    //       val                                  the length of the string
+    //       str_field                            the string itself
     //       length() : Int                       returns length of the string
     //       concat(arg: Str) : Str               performs string concatenation
     //       substr(arg: Int, arg2: Int): Str     substring selection
@@ -296,618 +1436,5087 @@ void ClassTable::install_basic_classes() {
                               no_expr()))),
            filename);
 
-    inheritance_graph.insert(std::pair<Symbol, Class_>(Object, Object_class));
-    inheritance_graph.insert(std::pair<Symbol, Class_>(IO, IO_class));
-    inheritance_graph.insert(std::pair<Symbol, Class_>(Int, Int_class));
-    inheritance_graph.insert(std::pair<Symbol, Class_>(Bool, Bool_class));
-    inheritance_graph.insert(std::pair<Symbol, Class_>(Str, Str_class));
+    inheritance_graph.insert(std::pair<Symbol, Class_>(Object, Object_class));
+    inheritance_graph.insert(std::pair<Symbol, Class_>(IO, IO_class));
+    inheritance_graph.insert(std::pair<Symbol, Class_>(Int, Int_class));
+    inheritance_graph.insert(std::pair<Symbol, Class_>(Bool, Bool_class));
+    inheritance_graph.insert(std::pair<Symbol, Class_>(Str, Str_class));
+}
+
+////////////////////////////////////////////////////////////////////
+//
+// semant_error is an overloaded function for reporting errors
+// during semantic analysis.  There are three versions:
+//
+//    ostream& ClassTable::semant_error()                
+//
+//    ostream& ClassTable::semant_error(Class_ c)
+//       print line number and filename for `c'
+//
+//    ostream& ClassTable::semant_error(Symbol filename, tree_node *t)  
+//       print a line number and filename
+//
+///////////////////////////////////////////////////////////////////
+
+ostream& ClassTable::semant_error(Class_ c)
+{                                                             
+    return semant_error(c->get_filename(),c);
+}    
+
+ostream& ClassTable::semant_error(Symbol filename, tree_node *t)
+{
+    error_stream << filename << ":" << t->get_line_number() << ": ";
+    return semant_error();
+}
+
+ostream& ClassTable::semant_error()                  
+{                                                 
+    semant_errors++;                            
+    return error_stream;
+} 
+
+bool subClass(Symbol first, Symbol parent)
+{
+    /* a range check once both classes have tags. */
+    std::map<Symbol, class_tag>::iterator first_tag = class_tags.find(first);
+    if(first_tag!=class_tags.end())
+    {
+        std::map<Symbol, class_tag>::iterator parent_tag = class_tags.find(parent);
+        if(parent_tag!=class_tags.end())
+            return parent_tag->second.tag < first_tag->second.tag && first_tag->second.tag <= parent_tag->second.last;
+    }
+
+    while(first!=No_class)
+    {
+        /* a class that is not (yet) in the graph conforms to nothing. */
+        std::map<Symbol, Class_>::iterator it = inheritance_graph.find(first);
+        if(it==inheritance_graph.end())
+            return false;
+        first = it->second->get_parent();
+        if(first == parent)
+            return true;
+    }
+    return false;
+}
+
+/*
+   Finds the method `method_name' of `cur_class' or of its nearest
+   ancestor that defines it, and stores that ancestor in `*defining'
+   when it is not NULL.  Attributes of the same name are skipped.
+   Returns NULL when there is no such method.
+ */
+Feature getmethods(Class_ cur_class , Symbol method_name, Class_ *defining)
+{
+    dispatch_entry entry;
+    if(!dispatch_cache.lookup(cur_class, method_name, entry))
+    {
+        entry.receiver = cur_class;
+        entry.name = method_name;
+        entry.feature = NULL;
+        entry.defining = NULL;
+        Class_ c = cur_class;
+        while(c!=NULL && entry.feature==NULL)
+        {
+            entry.feature = c->find_method(method_name);
+            if(entry.feature!=NULL)
+                entry.defining = c;
+            std::map<Symbol, Class_>::iterator it = inheritance_graph.find(c->get_parent());
+            c = it==inheritance_graph.end() ? NULL : it->second;
+        }
+        dispatch_cache.insert(entry);
+    }
+    if(defining!=NULL)
+        *defining = entry.defining;
+    return entry.feature;
+}
+
+Feature getmethods(Class_ cur_class , Symbol method_name)
+{
+    return getmethods(cur_class, method_name, NULL);
+}
+
+/* marks `e' as failed: the tree keeps Object, and the parent gets the poison type. */
+static Symbol poison_type(Expression e)
+{
+    e->set_type(Object);
+    e->set_void_source(MAYBE_VOID);
+    return poison;
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// Non-void analysis
+//
+// Generated code tests every dispatch receiver for void.  While a
+// feature is checked, each expression records where its value comes
+// from: NEVER_VOID for self, `new', and any Int, Bool or String value,
+// MAYBE_VOID when nothing is known, or the index of the let or case
+// local it reads.  A local is never void if no value stored in it may
+// be void.  That is only known once the whole feature has been seen,
+// so finish_void_analysis settles the locals at the end of each
+// feature, ignoring the order of the stores, and rewrites every
+// expression that read one to NEVER_VOID or MAYBE_VOID.
+//
+//////////////////////////////////////////////////////////////////////
+
+/* the locals of the feature being checked, keyed by their scope entry. */
+static std::map<Symbol *, int> void_locals;
+static std::vector<bool> local_maybe_void;
+/* (local, local whose value was stored in it) */
+static std::vector<std::pair<int, int> > local_copies;
+/* expressions that read a local, settled by finish_void_analysis. */
+static std::vector<Expression> local_readers;
+/* dispatch receivers and isvoid operands, for the report. */
+static std::vector<Expression> void_check_operands;
+
+/* records that `e', of type `type', takes its value from `source'. */
+static void record_void_source(Expression e, Symbol type, int source)
+{
+    if(type==Int || type==Bool || type==Str)
+        source = NEVER_VOID;
+    e->set_void_source(source);
+    if(source>=0)
+        local_readers.push_back(e);
+}
+
+/* the source of a value that is either of two values. */
+static int join_void_sources(int a, int b)
+{
+    return a==b ? a : MAYBE_VOID;
+}
+
+/* the local bound to scope entry `binding', or MAYBE_VOID for a formal or an attribute. */
+static int local_source(Symbol *binding)
+{
+    std::map<Symbol *, int>::iterator found = void_locals.find(binding);
+    return found==void_locals.end() ? MAYBE_VOID : found->second;
+}
+
+static void store_local(int local, int source)
+{
+    if(source==MAYBE_VOID)
+        local_maybe_void[local] = true;
+    else if(source>=0)
+        local_copies.push_back(std::pair<int, int>(local, source));
+}
+
+/* makes `binding' a local whose initial value comes from `source'. */
+static void bind_local(Symbol *binding, int source)
+{
+    int local = local_maybe_void.size();
+    void_locals[binding] = local;
+    local_maybe_void.push_back(false);
+    store_local(local, source);
+}
+
+static void begin_void_analysis()
+{
+    void_locals.clear();
+    local_maybe_void.clear();
+    local_copies.clear();
+    local_readers.clear();
+}
+
+static void finish_void_analysis()
+{
+    bool changed = true;
+    while(changed)
+    {
+        changed = false;
+        for(size_t i=0; i<local_copies.size(); i++)
+        {
+            if(local_maybe_void[local_copies[i].second] && !local_maybe_void[local_copies[i].first])
+            {
+                local_maybe_void[local_copies[i].first] = true;
+                changed = true;
+            }
+        }
+    }
+    for(size_t i=0; i<local_readers.size(); i++)
+    {
+        Expression e = local_readers[i];
+        e->set_void_source(local_maybe_void[e->get_void_source()] ? MAYBE_VOID : NEVER_VOID);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// Class hierarchy analysis
+//
+// Every dispatch that checks cleanly is recorded with the class its
+// receiver resolves to.  Once the whole program has checked, a dispatch
+// whose method is not redefined by any subclass of that receiver class
+// can only ever reach one method.  annotate_monomorphic_dispatches
+// stores that method, and the class defining it, on the dispatch node
+// so the code generator can call it directly.
+//
+//////////////////////////////////////////////////////////////////////
+
+struct dispatch_site {
+    dispatch_class *node;
+    Class_ receiver;
+    Symbol name;
+};
+
+static std::vector<dispatch_site> dispatch_sites;
+static long monomorphic_sites = 0;
+
+static bool defines_method(Class_ c, Symbol name)
+{
+    return c->find_method(name)!=NULL;
+}
+
+/* true if any proper subclass of `c' redefines method `name'. */
+static bool overridden_below(Class_ c, Symbol name,
+                             std::map<Symbol, std::vector<Class_> > &children,
+                             std::map<std::pair<Class_, Symbol>, bool> &memo)
+{
+    std::pair<Class_, Symbol> key(c, name);
+    std::map<std::pair<Class_, Symbol>, bool>::iterator found = memo.find(key);
+    if(found!=memo.end())
+        return found->second;
+
+    bool overridden = false;
+    std::vector<Class_> pending(1, c);
+    while(!pending.empty() && !overridden)
+    {
+        std::vector<Class_> &below = children[pending.back()->get_name()];
+        pending.pop_back();
+        for(size_t i=0; i<below.size() && !overridden; i++)
+        {
+            overridden = defines_method(below[i], name);
+            pending.push_back(below[i]);
+        }
+    }
+    memo.insert(std::pair<std::pair<Class_, Symbol>, bool>(key, overridden));
+    return overridden;
+}
+
+static void annotate_monomorphic_dispatches()
+{
+    std::map<Symbol, std::vector<Class_> > children;
+    std::map<Symbol, Class_>::iterator it;
+    for(it = inheritance_graph.begin(); it!=inheritance_graph.end(); it++)
+    {
+        if(it->first!=Object)
+            children[it->second->get_parent()].push_back(it->second);
+    }
+
+    std::map<std::pair<Class_, Symbol>, bool> memo;
+    monomorphic_sites = 0;
+    for(size_t i=0; i<dispatch_sites.size(); i++)
+    {
+        dispatch_site &site = dispatch_sites[i];
+        if(overridden_below(site.receiver, site.name, children, memo))
+            continue;
+        Class_ defining;
+        Feature target = getmethods(site.receiver, site.name, &defining);
+        site.node->set_target(target, defining);
+        monomorphic_sites++;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// Reachability
+//
+// While a feature is checked, every dispatch, static dispatch and `new'
+// in it is recorded as a call edge of that feature.  After checking,
+// compute_reachability walks these edges from Main.main in the style of
+// rapid type analysis.  A class is live once it can be instantiated.
+// A dynamic dispatch reaches the method as resolved in every live class
+// that conforms to the receiver, including classes that only become
+// live later.  Instantiating a class runs the attribute initializers of
+// the class and of its ancestors.  `new SELF_TYPE' creates an object of
+// a class that is already live, so it adds nothing.  With
+// SEMANT_REACHABLE=path the live classes and reachable methods are
+// written to `path' for the code generator.
+//
+//////////////////////////////////////////////////////////////////////
+
+enum call_kind {
+    DISPATCH_CALL,
+    STATIC_DISPATCH_CALL,
+    NEW_CALL
+};
+
+struct call_edge {
+    call_kind kind;
+    Class_ target;        /* receiver class, static type, or class created */
+    Symbol name;          /* method name; NULL for NEW_CALL */
+};
+
+/* the feature being checked, and the calls made by each checked feature. */
+static Feature current_feature = NULL;
+static std::map<Feature, std::vector<call_edge> > feature_calls;
+
+static std::set<Class_> live_classes;
+static std::map<Feature, Class_> reachable_methods;   /* method -> class that defines it */
+
+static void record_call(call_kind kind, Class_ target, Symbol name)
+{
+    if(current_feature==NULL)
+        return;
+    call_edge edge = { kind, target, name };
+    feature_calls[current_feature].push_back(edge);
+}
+
+static std::vector<Feature> pending_methods;
+static std::vector<Class_> pending_classes;
+static std::vector<std::pair<Class_, Symbol> > live_dispatches;
+static std::set<std::pair<Class_, Symbol> > live_dispatch_keys;
+
+static bool conforms_to(Class_ c, Class_ receiver)
+{
+    return c==receiver || subClass(c->get_name(), receiver->get_name());
+}
+
+static void reach_method(Class_ receiver, Symbol name)
+{
+    Class_ defining;
+    Feature method = getmethods(receiver, name, &defining);
+    if(method!=NULL && reachable_methods.insert(std::pair<Feature, Class_>(method, defining)).second)
+        pending_methods.push_back(method);
+}
+
+static void instantiate(Class_ c)
+{
+    if(live_classes.insert(c).second)
+        pending_classes.push_back(c);
+}
+
+static void follow_calls(Feature feature)
+{
+    std::map<Feature, std::vector<call_edge> >::iterator it = feature_calls.find(feature);
+    if(it==feature_calls.end())
+        return;
+    std::vector<call_edge> &edges = it->second;
+    for(size_t i=0; i<edges.size(); i++)
+    {
+        call_edge &edge = edges[i];
+        if(edge.kind==NEW_CALL)
+            instantiate(edge.target);
+        else if(edge.kind==STATIC_DISPATCH_CALL)
+            reach_method(edge.target, edge.name);
+        else if(live_dispatch_keys.insert(std::pair<Class_, Symbol>(edge.target, edge.name)).second)
+        {
+            live_dispatches.push_back(std::pair<Class_, Symbol>(edge.target, edge.name));
+            for(std::set<Class_>::iterator c = live_classes.begin(); c!=live_classes.end(); c++)
+            {
+                if(conforms_to(*c, edge.target))
+                    reach_method(*c, edge.name);
+            }
+        }
+    }
+}
+
+static void compute_reachability()
+{
+    live_classes.clear();
+    reachable_methods.clear();
+    live_dispatches.clear();
+    live_dispatch_keys.clear();
+
+    /* the runtime creates the basic values and the Main object itself. */
+    Symbol roots[] = { Int, Bool, Str, Main };
+    for(size_t i=0; i<sizeof(roots)/sizeof(roots[0]); i++)
+    {
+        std::map<Symbol, Class_>::iterator it = inheritance_graph.find(roots[i]);
+        if(it!=inheritance_graph.end())
+            instantiate(it->second);
+    }
+    std::map<Symbol, Class_>::iterator main_class = inheritance_graph.find(Main);
+    if(main_class!=inheritance_graph.end())
+        reach_method(main_class->second, main_meth);
+
+    while(!pending_classes.empty() || !pending_methods.empty())
+    {
+        if(!pending_classes.empty())
+        {
+            Class_ c = pending_classes.back();
+            pending_classes.pop_back();
+            for(Class_ a = c; a!=NULL; )
+            {
+                Features features = a->get_features();
+                for(int i=features->first(); features->more(i); i=features->next(i))
+                {
+                    if(features->nth(i)->get_formals()==NULL)
+                        follow_calls(features->nth(i));
+                }
+                std::map<Symbol, Class_>::iterator parent = inheritance_graph.find(a->get_parent());
+                a = parent==inheritance_graph.end() ? NULL : parent->second;
+            }
+            for(size_t i=0; i<live_dispatches.size(); i++)
+            {
+                if(conforms_to(c, live_dispatches[i].first))
+                    reach_method(c, live_dispatches[i].second);
+            }
+        }
+        else
+        {
+            Feature method = pending_methods.back();
+            pending_methods.pop_back();
+            follow_calls(method);
+        }
+    }
+}
+
+/* a class is emitted if it is live or an ancestor of a live class. */
+static void emit_reachable_class(FILE *out, Class_ c, std::set<Class_> &needed)
+{
+    if(needed.find(c)==needed.end())
+        return;
+    fprintf(out, "class %s\n", c->get_name()->get_string());
+    Features features = c->get_features();
+    for(int i=features->first(); features->more(i); i=features->next(i))
+    {
+        Feature feature = features->nth(i);
+        if(reachable_methods.find(feature)!=reachable_methods.end())
+            fprintf(out, "method %s.%s\n", c->get_name()->get_string(), feature->get_name()->get_string());
+    }
+}
+
+/* writes the reachable set for `classes' to the SEMANT_REACHABLE file, basic classes first. */
+static void emit_reachable(Classes classes)
+{
+    char *path = getenv("SEMANT_REACHABLE");
+    if(path==NULL || *path=='\0')
+        return;
+    FILE *out = fopen(path, "w");
+    if(out==NULL)
+    {
+        cerr << "Could not write reachable set to " << path << endl;
+        return;
+    }
+
+    std::set<Class_> needed;
+    for(std::set<Class_>::iterator it = live_classes.begin(); it!=live_classes.end(); it++)
+    {
+        for(Class_ a = *it; a!=NULL && needed.insert(a).second; )
+        {
+            std::map<Symbol, Class_>::iterator parent = inheritance_graph.find(a->get_parent());
+            a = parent==inheritance_graph.end() ? NULL : parent->second;
+        }
+    }
+
+    Symbol basic[] = { Object, IO, Int, Bool, Str };
+    for(size_t i=0; i<sizeof(basic)/sizeof(basic[0]); i++)
+        emit_reachable_class(out, inheritance_graph.find(basic[i])->second, needed);
+    for(int i=classes->first(); classes->more(i); i=classes->next(i))
+        emit_reachable_class(out, classes->nth(i), needed);
+    fclose(out);
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// Object layout
+//
+// compute_layouts gives every class the layout the code generator
+// uses.  Attributes are laid out in inheritance order: all of the
+// parent's attributes, then the class's own, in declaration order.  The
+// basic classes contribute their built-in slots (_val, _str_field)
+// like any other attribute.  Dispatch tables start as a copy of the
+// parent's; a redefined method keeps its slot, and new methods are
+// appended.  The tables are stored flat in layout_attributes and
+// layout_methods, and each class_layout records its range in each.
+// With SEMANT_LAYOUT=path the tables are also written to `path'.
+//
+//////////////////////////////////////////////////////////////////////
+
+/* tag, size and dispatch pointer come before the first attribute. */
+static const int object_header_words = 3;
+
+struct layout_attribute {
+    Symbol name;
+    Symbol type;
+};
+
+struct layout_method {
+    Symbol name;
+    Class_ defining;
+};
+
+struct class_layout {
+    Class_ cls;
+    unsigned int first_attribute;
+    unsigned int attributes;
+    unsigned int first_method;
+    unsigned int methods;
+};
+
+static std::vector<layout_attribute> layout_attributes;
+static std::vector<layout_method> layout_methods;
+static std::vector<class_layout> class_layouts;
+static std::map<Symbol, int> layout_index;
+
+/* lays out `c', whose parent (if any) has been laid out already. */
+static void lay_out_class(Class_ c)
+{
+    class_layout layout = { c, (unsigned int) layout_attributes.size(), 0, (unsigned int) layout_methods.size(), 0 };
+    std::map<Symbol, int>::iterator parent = layout_index.find(c->get_parent());
+    if(parent!=layout_index.end())
+    {
+        class_layout inherited = class_layouts[parent->second];
+        for(unsigned int i=0; i<inherited.attributes; i++)
+            layout_attributes.push_back(layout_attributes[inherited.first_attribute + i]);
+        for(unsigned int i=0; i<inherited.methods; i++)
+            layout_methods.push_back(layout_methods[inherited.first_method + i]);
+    }
+
+    Features features = c->get_features();
+    for(int i=features->first(); features->more(i); i=features->next(i))
+    {
+        Feature feature = features->nth(i);
+        if(feature->get_formals()==NULL)
+        {
+            layout_attribute attribute = { feature->get_name(), feature->get_return_type() };
+            layout_attributes.push_back(attribute);
+            continue;
+        }
+        layout_method method = { feature->get_name(), c };
+        size_t slot = layout.first_method;
+        while(slot<layout_methods.size() && layout_methods[slot].name!=method.name)
+            slot++;
+        if(slot<layout_methods.size())
+            layout_methods[slot] = method;
+        else
+            layout_methods.push_back(method);
+    }
+
+    layout.attributes = layout_attributes.size() - layout.first_attribute;
+    layout.methods = layout_methods.size() - layout.first_method;
+    layout_index.insert(std::pair<Symbol, int>(c->get_name(), class_layouts.size()));
+    class_layouts.push_back(layout);
+}
+
+static void compute_layouts()
+{
+    layout_attributes.clear();
+    layout_methods.clear();
+    class_layouts.clear();
+    layout_index.clear();
+
+    std::map<Symbol, Class_>::iterator it;
+    for(it = inheritance_graph.begin(); it!=inheritance_graph.end(); it++)
+    {
+        /* lay out the ancestors that are still missing, root first. */
+        std::vector<Class_> chain;
+        for(Class_ c = it->second; c!=NULL && layout_index.find(c->get_name())==layout_index.end(); )
+        {
+            chain.push_back(c);
+            std::map<Symbol, Class_>::iterator parent = inheritance_graph.find(c->get_parent());
+            c = parent==inheritance_graph.end() ? NULL : parent->second;
+        }
+        while(!chain.empty())
+        {
+            lay_out_class(chain.back());
+            chain.pop_back();
+        }
+    }
+}
+
+/* the layout of class `name', or NULL if it has none. */
+const class_layout *get_class_layout(Symbol name)
+{
+    std::map<Symbol, int>::iterator it = layout_index.find(name);
+    return it==layout_index.end() ? NULL : &class_layouts[it->second];
+}
+
+/* the word offset of attribute `attribute' in objects of class `cls', or -1. */
+int attribute_offset(Symbol cls, Symbol attribute)
+{
+    const class_layout *layout = get_class_layout(cls);
+    if(layout==NULL)
+        return -1;
+    for(unsigned int i=0; i<layout->attributes; i++)
+    {
+        if(layout_attributes[layout->first_attribute + i].name==attribute)
+            return object_header_words + i;
+    }
+    return -1;
+}
+
+/* the slot of method `method' in the dispatch table of class `cls', or -1. */
+int dispatch_index(Symbol cls, Symbol method)
+{
+    const class_layout *layout = get_class_layout(cls);
+    if(layout==NULL)
+        return -1;
+    for(unsigned int i=0; i<layout->methods; i++)
+    {
+        if(layout_methods[layout->first_method + i].name==method)
+            return i;
+    }
+    return -1;
+}
+
+static void emit_class_layout(FILE *out, Class_ c)
+{
+    const class_layout *layout = get_class_layout(c->get_name());
+    if(layout==NULL || layout->cls!=c)
+        return;
+    fprintf(out, "class %s %u %u\n", c->get_name()->get_string(), layout->attributes, layout->methods);
+    for(unsigned int i=0; i<layout->attributes; i++)
+    {
+        layout_attribute &attribute = layout_attributes[layout->first_attribute + i];
+        fprintf(out, "  attr %d %s %s\n", object_header_words + i,
+                attribute.name->get_string(), attribute.type->get_string());
+    }
+    for(unsigned int i=0; i<layout->methods; i++)
+    {
+        layout_method &method = layout_methods[layout->first_method + i];
+        fprintf(out, "  method %u %s.%s\n", i,
+                method.defining->get_name()->get_string(), method.name->get_string());
+    }
+}
+
+/* writes the layouts for `classes' to the SEMANT_LAYOUT file, basic classes first. */
+static void emit_layouts(Classes classes)
+{
+    char *path = getenv("SEMANT_LAYOUT");
+    if(path==NULL || *path=='\0')
+        return;
+    FILE *out = fopen(path, "w");
+    if(out==NULL)
+    {
+        cerr << "Could not write class layouts to " << path << endl;
+        return;
+    }
+
+    Symbol basic[] = { Object, IO, Int, Bool, Str };
+    for(size_t i=0; i<sizeof(basic)/sizeof(basic[0]); i++)
+        emit_class_layout(out, inheritance_graph.find(basic[i])->second);
+    for(int i=classes->first(); classes->more(i); i=classes->next(i))
+        emit_class_layout(out, classes->nth(i));
+    fclose(out);
+}
+
+Symbol assign_class::get_expression_type(Class_ cur_class)
+{
+    Symbol *left_type = attribute_table->lookup(name);
+    if(left_type==NULL)
+    {
+        diagnose(classtable, cur_class, UNDECLARED_ASSIGN_ERROR, name);
+        return poison_type(this);
+    }
+
+    Symbol right_type = expr->get_expression_type(cur_class);
+    if(right_type==poison)
+        return poison_type(this);
+    if(*left_type!=right_type && (!subClass(right_type,*left_type)))
+    {
+        diagnose(classtable, cur_class, ASSIGN_CONFORMANCE_ERROR, right_type, *left_type, name);
+        return poison_type(this);
+    }
+
+    type = *left_type;
+    int local = local_source(left_type);
+    if(local>=0)
+        store_local(local, expr->get_void_source());
+    record_void_source(this, type, expr->get_void_source());
+    return *left_type;
+}
+
+Symbol static_dispatch_class::get_expression_type(Class_ cur_class)
+{
+    Symbol first_expr_type = expr->get_expression_type(cur_class);
+    if(first_expr_type==poison)
+        return poison_type(this);
+    if(inheritance_graph.find(type_name)==inheritance_graph.end())
+    {
+        diagnose(classtable, cur_class, STATIC_DISPATCH_CLASS_ERROR, type_name);
+        return poison_type(this);
+    }
+    if(first_expr_type==SELF_TYPE)
+        first_expr_type=cur_class->get_name();
+    if(first_expr_type!=type_name &&(!subClass(first_expr_type,type_name)))
+    {
+        diagnose(classtable, cur_class, STATIC_DISPATCH_CONFORMANCE_ERROR, first_expr_type, type_name);
+        return poison_type(this);
+    }
+
+    Class_ static_class = inheritance_graph.find(type_name)->second;
+    Class_ defining;
+    Feature feature = getmethods(static_class,name,&defining);
+    if(feature==NULL)
+    {
+        diagnose(classtable, cur_class, STATIC_DISPATCH_METHOD_ERROR, name);
+        return poison_type(this);
+    }
+    set_resolved_method(feature, defining);
+
+    method_signature signature = signatures[intern_signature(feature)];
+    if(actual->len()!=(int) signature.arity)
+    {
+        diagnose(classtable, cur_class, ACTUALS_COUNT_ERROR);
+        return poison_type(this);
+    }
+    for(int i=actual->first();actual->more(i);i=actual->next(i))
+    {
+        Symbol actual_type = actual->nth(i)->get_expression_type(cur_class);
+        Symbol formal_type = signature_types[signature.offset + i];
+        if(actual_type==poison)
+            return poison_type(this);
+        if(actual_type!=formal_type&& (!subClass(actual_type,formal_type)))
+        {
+            diagnose(classtable, cur_class, ACTUALS_CONFORMANCE_ERROR);
+            return poison_type(this);
+        }
+    }
+
+    record_call(STATIC_DISPATCH_CALL, static_class, name);
+    void_check_operands.push_back(expr);
+    type = feature->get_return_type();
+    if(type==SELF_TYPE)
+        type = first_expr_type;
+    record_void_source(this, type, MAYBE_VOID);
+    return type;
+}
+
+Symbol dispatch_class::get_expression_type(Class_ cur_class)
+{
+    Symbol first_expr_type = expr->get_expression_type(cur_class);
+    if(first_expr_type==poison)
+        return poison_type(this);
+    Class_ receiver_class = cur_class;
+    if(first_expr_type!=SELF_TYPE)
+    {
+        std::map<Symbol, Class_>::iterator receiver = inheritance_graph.find(first_expr_type);
+        if(receiver==inheritance_graph.end())
+        {
+            diagnose(classtable, cur_class, DISPATCH_CLASS_ERROR, first_expr_type);
+            return poison_type(this);
+        }
+        receiver_class = receiver->second;
+    }
+    Class_ defining;
+    Feature feature = getmethods(receiver_class,name,&defining);
+    if(feature==NULL)
+    {
+        diagnose(classtable, cur_class, DISPATCH_METHOD_ERROR, name);
+        return poison_type(this);   
+    }
+    set_resolved_method(feature, defining);
+    method_signature signature = signatures[intern_signature(feature)];
+    if(actual->len()!=(int) signature.arity)
+    {
+        diagnose(classtable, cur_class, ACTUALS_COUNT_ERROR);
+        return poison_type(this);
+    }
+    for(int i=actual->first();actual->more(i);i=actual->next(i))
+    {
+        Symbol actual_type = actual->nth(i)->get_expression_type(cur_class);
+        Symbol formal_type = signature_types[signature.offset + i];
+        if(actual_type==poison)
+            return poison_type(this);
+        if(actual_type==SELF_TYPE)
+            actual_type=cur_class->get_name();
+        if(actual_type!=formal_type&& (!subClass(actual_type,formal_type)))
+        {
+            diagnose(classtable, cur_class, ACTUALS_CONFORMANCE_ERROR);
+            return poison_type(this);
+        }
+    }
+    dispatch_site site = { this, receiver_class, name };
+    dispatch_sites.push_back(site);
+    record_call(DISPATCH_CALL, receiver_class, name);
+    void_check_operands.push_back(expr);
+    type = feature->get_return_type();
+    if(type ==SELF_TYPE)
+        type = first_expr_type;
+    record_void_source(this, type, MAYBE_VOID);
+    return type;
+}
+
+/* the least common ancestor of `a' and `b'; SELF_TYPE is `cur_class' unless both are SELF_TYPE. */
+static Symbol lub(Symbol a, Symbol b, Class_ cur_class)
+{
+    if(a==b)
+        return a;
+    if(a==SELF_TYPE)
+        a = cur_class->get_name();
+    if(b==SELF_TYPE)
+        b = cur_class->get_name();
+    Symbol pair[2] = { a, b }, result;
+    if(join_ancestors(pair, 2, result))
+        return result;
+    while(a!=b && !subClass(b, a))
+    {
+        std::map<Symbol, Class_>::iterator it = inheritance_graph.find(a);
+        if(it==inheritance_graph.end())
+            return Object;
+        a = it->second->get_parent();
+    }
+    return a;
+}
+
+/* the least common ancestor of all of `types', with one AND or range walk per type. */
+static Symbol lub(std::vector<Symbol> types, Class_ cur_class)
+{
+    bool same = true;
+    for(size_t i=1; i<types.size(); i++)
+        same = same && types[i]==types[0];
+    if(same)
+        return types[0];
+
+    for(size_t i=0; i<types.size(); i++)
+    {
+        if(types[i]==SELF_TYPE)
+            types[i] = cur_class->get_name();
+    }
+    Symbol result;
+    if(join_ancestors(&types[0], types.size(), result))
+        return result;
+    result = types[0];
+    for(size_t i=1; i<types.size(); i++)
+        result = lub(result, types[i], cur_class);
+    return result;
+}
+
+/* Int arithmetic wraps around at 32 bits, as it does at run time. */
+static int wrap_int(long long value)
+{
+    return (int) (unsigned int) value;
+}
+
+Symbol cond_class::get_expression_type(Class_ cur_class)
+{
+    Symbol pred_type = pred->get_expression_type(cur_class);
+    bool failed = pred_type==poison;
+    if(pred_type!=Bool && !failed)
+    {
+        diagnose(classtable, cur_class, COND_PREDICATE_ERROR);
+        failed = true;
+    }
+    Symbol then_type = then_exp->get_expression_type(cur_class);
+    Symbol else_type = else_exp->get_expression_type(cur_class);
+    if(failed || then_type==poison || else_type==poison)
+        return poison_type(this);
+
+    int value;
+    known_pred = pred->get_constant(value) ? value : -1;
+    type = lub(then_type, else_type, cur_class);
+    if(known_pred==-1)
+        record_void_source(this, type, join_void_sources(then_exp->get_void_source(), else_exp->get_void_source()));
+    else
+        record_void_source(this, type, known_pred ? then_exp->get_void_source() : else_exp->get_void_source());
+    return type;
+}
+
+Symbol loop_class::get_expression_type(Class_ cur_class)
+{
+    Symbol pred_type = pred->get_expression_type(cur_class);
+    if(pred_type!=Bool && pred_type!=poison)
+    {
+        diagnose(classtable, cur_class, LOOP_PREDICATE_ERROR);
+    }
+    int value;
+    known_pred = pred_type==Bool && pred->get_constant(value) ? value : -1;
+    body->get_expression_type(cur_class);
+    type = Object;
+    record_void_source(this, type, MAYBE_VOID);
+    return Object;
+}
+
+/*
+   Adds `sym' to `set', an open-addressing table of at least twice as
+   many slots as will be added.  Returns true if it was already there.
+ */
+static bool symbol_set_insert(std::vector<Symbol> &set, Symbol sym)
+{
+    size_t mask = set.size() - 1;
+    size_t i = ((size_t) sym >> 3) * 2654435761u & mask;
+    while(set[i]!=NULL)
+    {
+        if(set[i]==sym)
+            return true;
+        i = (i + 1) & mask;
+    }
+    set[i] = sym;
+    return false;
+}
+
+/* every case expression that checked cleanly, for annotate_branches. */
+static std::vector<typcase_class *> typcase_sites;
+
+Symbol typcase_class::get_expression_type(Class_ cur_class)
+{
+    bool failed = expr->get_expression_type(cur_class)==poison;
+
+    size_t slots = 4;
+    while(slots < 2 * (size_t) cases->len())
+        slots *= 2;
+    std::vector<Symbol> seen(slots, (Symbol) NULL);
+
+    std::vector<Symbol> branch_types;
+    for(int i=cases->first(); cases->more(i); i=cases->next(i))
+    {
+        Case branch = cases->nth(i);
+        if(symbol_set_insert(seen, branch->get_type_decl()))
+        {
+            diagnose(classtable, cur_class, CASE_DUPLICATE_ERROR, branch->get_type_decl());
+            failed = true;
+        }
+        Symbol branch_type = branch->check_branch(cur_class);
+        if(branch_type==poison)
+            failed = true;
+        else
+            branch_types.push_back(branch_type);
+    }
+
+    if(failed || branch_types.empty())
+        return poison_type(this);
+    typcase_sites.push_back(this);
+    type = lub(branch_types, cur_class);
+    int source = cases->nth(cases->first())->get_expr()->get_void_source();
+    for(int i=cases->first(); cases->more(i); i=cases->next(i))
+        source = join_void_sources(source, cases->nth(i)->get_expr()->get_void_source());
+    record_void_source(this, type, source);
+    return type;
+}
+
+/* checks one branch with its identifier bound; an unusable declaration binds it to poison. */
+Symbol branch_class::check_branch(Class_ cur_class)
+{
+    Symbol bound = type_decl;
+    if(name==self)
+    {
+        diagnose(classtable, cur_class, CASE_SELF_ERROR);
+        bound = poison;
+    }
+    else if(type_decl==SELF_TYPE)
+    {
+        diagnose(classtable, cur_class, CASE_SELF_TYPE_ERROR, name);
+        bound = poison;
+    }
+    else if(inheritance_graph.find(type_decl)==inheritance_graph.end())
+    {
+        diagnose(classtable, cur_class, CASE_BRANCH_CLASS_ERROR, type_decl);
+        bound = poison;
+    }
+
+    attribute_table->enterscope();
+    if(name!=self)
+    {
+        /* a case on void aborts, so the bound object is never void. */
+        Symbol *binding = new Symbol(bound);
+        attribute_table->addid(name, binding);
+        bind_local(binding, NEVER_VOID);
+    }
+    Symbol branch_type = expr->get_expression_type(cur_class);
+    attribute_table->exitscope();
+    return bound==poison ? poison : branch_type;
+}
+
+static bool deeper_branch(const std::pair<int, Case> &a, const std::pair<int, Case> &b)
+{
+    return a.first > b.first;
+}
+
+/*
+   Gives each branch the tag range of its class and orders the branches
+   by descending tag.  A subclass always has a larger preorder tag than
+   its ancestors, so the first branch whose range holds the object's
+   tag is the closest match, as the case rule requires.  It builds no
+   tree nodes, which semant_streaming relies on.
+ */
+void typcase_class::annotate_branches()
+{
+    std::vector<std::pair<int, Case> > order;
+    for(int i=cases->first(); cases->more(i); i=cases->next(i))
+    {
+        Case branch = cases->nth(i);
+        class_tag tag = class_tags[branch->get_type_decl()];
+        branch->set_tag_range(tag.tag, tag.last);
+        order.push_back(std::pair<int, Case>(tag.tag, branch));
+    }
+    std::stable_sort(order.begin(), order.end(), deeper_branch);
+
+    sorted_cases.clear();
+    for(size_t i=0; i<order.size(); i++)
+        sorted_cases.push_back(order[i].second);
+}
+
+Symbol block_class::get_expression_type(Class_ cur_class)
+{
+    Symbol expr_type = poison;
+    Expression last = NULL;
+    for(int i=body->first();body->more(i);i=body->next(i))
+    {
+        last = body->nth(i);
+        expr_type=last->get_expression_type(cur_class);
+    }
+    /* the parser never gives an empty block, but a hand-built tree can. */
+    if(last==NULL || expr_type==poison)
+        return poison_type(this);
+    type = expr_type;
+    record_void_source(this, type, last->get_void_source());
+    return expr_type;
+}
+
+/* how many let chains were checked, and the most bindings in one. */
+static long let_chains = 0;
+static long longest_let_chain = 0;
+
+/*
+   The parser turns `let a, b, c in e' into three nested lets.  The
+   whole chain is checked here in one loop with one scope frame: each
+   initializer is typed before its own binding is added, and a later
+   binding of the same name sits above the earlier one in the frame,
+   so the scoping is the same as one frame per let.
+ */
+Symbol let_class::get_expression_type(Class_ cur_class)
+{
+    std::vector<let_class *> chain;
+    Expression inner = this;
+    for(let_class *link = this; link!=NULL; link = dynamic_cast<let_class *>(inner))
+    {
+        chain.push_back(link);
+        inner = link->body;
+    }
+    let_chains++;
+    if((long) chain.size() > longest_let_chain)
+        longest_let_chain = chain.size();
+
+    bool failed = false;
+    attribute_table->enterscope();
+    for(size_t i=0; i<chain.size(); i++)
+    {
+        let_class *link = chain[i];
+        Symbol decl_type = link->type_decl==SELF_TYPE ? cur_class->get_name() : link->type_decl;
+        Symbol init_type = link->init->get_expression_type(cur_class);
+        if(init_type==SELF_TYPE)
+            init_type = cur_class->get_name();
+
+        /* SELF_TYPE is checked as the class, but the identifier stays SELF_TYPE. */
+        Symbol bound = link->type_decl;
+        if(inheritance_graph.find(decl_type)==inheritance_graph.end())
+        {
+            diagnose(classtable, cur_class, LET_TYPE_ERROR, link->type_decl, link->identifier);
+            bound = poison;
+            failed = true;
+        }
+        else if(init_type==poison)
+            failed = true;
+        else if(init_type!=No_type && init_type!=decl_type && !subClass(init_type, decl_type))
+        {
+            diagnose(classtable, cur_class, LET_INIT_ERROR, init_type, link->identifier, link->type_decl);
+            failed = true;
+        }
+
+        if(link->identifier==self)
+        {
+            diagnose(classtable, cur_class, LET_SELF_ERROR);
+            failed = true;
+            continue;
+        }
+        Symbol *binding = new Symbol(bound);
+        attribute_table->addid(link->identifier, binding);
+        bind_local(binding, link->init->get_void_source());
+    }
+    Symbol body_type = inner->get_expression_type(cur_class);
+    attribute_table->exitscope();
+
+    for(size_t i=chain.size(); i>0; i--)
+    {
+        if(failed || body_type==poison)
+        {
+            poison_type(chain[i-1]);
+            continue;
+        }
+        chain[i-1]->type = body_type;
+        record_void_source(chain[i-1], body_type, inner->get_void_source());
+    }
+    return failed ? poison : body_type;
+}
+
+Symbol plus_class::get_expression_type(Class_ cur_class)
+{
+    Symbol left = e1->get_expression_type(cur_class);
+    Symbol right = e2->get_expression_type(cur_class);
+    if(left==poison || right==poison)
+        return poison_type(this);
+    if(left!=Int || right!=Int)
+    {
+        diagnose(classtable, cur_class, PLUS_OPERAND_ERROR, left, right);
+        return poison_type(this);
+    }
+    int a, b;
+    if(e1->get_constant(a) && e2->get_constant(b))
+        set_constant(wrap_int((long long) a + b));
+    type = Int;
+    record_void_source(this, type, NEVER_VOID);
+    return Int;
+}
+
+Symbol sub_class::get_expression_type(Class_ cur_class)
+{
+    Symbol left = e1->get_expression_type(cur_class);
+    Symbol right = e2->get_expression_type(cur_class);
+    if(left==poison || right==poison)
+        return poison_type(this);
+    if(left!=Int || right!=Int)
+    {
+        diagnose(classtable, cur_class, SUB_OPERAND_ERROR, left, right);
+        return poison_type(this);
+    }
+    int a, b;
+    if(e1->get_constant(a) && e2->get_constant(b))
+        set_constant(wrap_int((long long) a - b));
+    type = Int;
+    record_void_source(this, type, NEVER_VOID);
+    return Int;
+}
+
+Symbol mul_class::get_expression_type(Class_ cur_class)
+{
+    Symbol left = e1->get_expression_type(cur_class);
+    Symbol right = e2->get_expression_type(cur_class);
+    if(left==poison || right==poison)
+        return poison_type(this);
+    if(left!=Int || right!=Int)
+    {
+        diagnose(classtable, cur_class, MUL_OPERAND_ERROR, left, right);
+        return poison_type(this);
+    }
+    int a, b;
+    if(e1->get_constant(a) && e2->get_constant(b))
+        set_constant(wrap_int((long long) a * b));
+    type = Int;
+    record_void_source(this, type, NEVER_VOID);
+    return Int;
+}
+
+Symbol divide_class::get_expression_type(Class_ cur_class)
+{
+    Symbol left = e1->get_expression_type(cur_class);
+    Symbol right = e2->get_expression_type(cur_class);
+    if(left==poison || right==poison)
+        return poison_type(this);
+    if(left!=Int || right!=Int)
+    {
+        diagnose(classtable, cur_class, DIVIDE_OPERAND_ERROR, left, right);
+        return poison_type(this);
+    }
+    int a, b;
+    if(e2->get_constant(b))
+    {
+        if(b==0)
+            warn(cur_class, DIVISION_BY_ZERO_WARNING);
+        else if(e1->get_constant(a) && !(a==INT_MIN && b==-1))
+            set_constant(a / b);
+    }
+    type = Int;
+    record_void_source(this, type, NEVER_VOID);
+    return Int;
+}
+
+Symbol neg_class::get_expression_type(Class_ cur_class)
+{
+    Symbol expr_type = e1->get_expression_type(cur_class);
+    if(expr_type==poison)
+        return poison_type(this);
+    if(expr_type!=Int)
+    {
+        diagnose(classtable, cur_class, NEG_OPERAND_ERROR, expr_type);
+        return poison_type(this);
+    }
+    int a;
+    if(e1->get_constant(a))
+        set_constant(wrap_int(-(long long) a));
+    type = Int;
+    record_void_source(this, type, NEVER_VOID);
+    return Int;
+}
+
+Symbol lt_class::get_expression_type(Class_ cur_class)
+{
+    Symbol left = e1->get_expression_type(cur_class);
+    Symbol right = e2->get_expression_type(cur_class);
+    if(left==poison || right==poison)
+        return poison_type(this);
+    if(left!=Int || right!=Int)
+    {
+        diagnose(classtable, cur_class, LT_OPERAND_ERROR, left, right);
+        return poison_type(this);
+    }
+    int a, b;
+    if(e1->get_constant(a) && e2->get_constant(b))
+        set_constant(a < b);
+    type = Bool;
+    record_void_source(this, type, NEVER_VOID);
+    return Bool;
+}
+
+Symbol eq_class::get_expression_type(Class_ cur_class)
+{
+    Symbol left = e1->get_expression_type(cur_class);
+    Symbol right = e2->get_expression_type(cur_class);
+    if(left==poison || right==poison)
+        return poison_type(this);
+    if(((left==Int|| right==Int) || (left==Bool|| right==Bool) || (left==Str|| right==Str))&& (left!=right))
+    {
+        diagnose(classtable, cur_class, EQ_OPERAND_ERROR);
+        return poison_type(this);
+    }
+    int a, b;
+    if(left==right && (left==Int || left==Bool) && e1->get_constant(a) && e2->get_constant(b))
+        set_constant(a==b);
+    type = Bool;
+    record_void_source(this, type, NEVER_VOID);
+    return Bool;
+
+}
+
+Symbol leq_class::get_expression_type(Class_ cur_class)
+{
+    Symbol left = e1->get_expression_type(cur_class);
+    Symbol right = e2->get_expression_type(cur_class);
+    if(left==poison || right==poison)
+        return poison_type(this);
+    if(left!=Int || right!=Int)
+    {
+        diagnose(classtable, cur_class, LEQ_OPERAND_ERROR, left, right);
+        return poison_type(this);
+    }
+    int a, b;
+    if(e1->get_constant(a) && e2->get_constant(b))
+        set_constant(a <= b);
+    type = Bool;
+    record_void_source(this, type, NEVER_VOID);
+    return Bool;
+}
+
+Symbol comp_class::get_expression_type(Class_ cur_class)
+{
+    Symbol expr_type=e1->get_expression_type(cur_class);
+    if(expr_type==poison)
+        return poison_type(this);
+    if(expr_type!=Bool)
+    {
+        diagnose(classtable, cur_class, COMP_OPERAND_ERROR, expr_type);
+        return poison_type(this);
+    }
+    int a;
+    if(e1->get_constant(a))
+        set_constant(!a);
+    type = Bool;
+    record_void_source(this, type, NEVER_VOID);
+    return Bool;
+}
+
+Symbol int_const_class::get_expression_type(Class_ cur_class)
+{
+    /* the lexer accepts any run of digits, which may not fit in an Int. */
+    long long value = 0;
+    for(char *digit = token->get_string(); *digit && value<=INT_MAX; digit++)
+        value = value * 10 + (*digit - '0');
+    if(value>INT_MAX)
+        warn(cur_class, INT_RANGE_WARNING, token);
+    else
+        set_constant(value);
+    type = Int;
+    record_void_source(this, type, NEVER_VOID);
+    return Int;
+}
+
+Symbol bool_const_class::get_expression_type(Class_ cur_class)
+{
+    set_constant(val ? 1 : 0);
+    type = Bool;
+    record_void_source(this, type, NEVER_VOID);
+    return Bool;
+}
+
+Symbol string_const_class::get_expression_type(Class_ cur_class)
+{
+    type = Str;
+    record_void_source(this, type, NEVER_VOID);
+    return Str;
+}
+
+Symbol new__class::get_expression_type(Class_ cur_class)
+{
+    if(type_name==SELF_TYPE)
+    {   
+        type = SELF_TYPE;
+        record_void_source(this, type, NEVER_VOID);
+        return type;
+    }
+    std::map<Symbol, Class_>::iterator created = inheritance_graph.find(type_name);
+    if(created==inheritance_graph.end())
+    {
+        diagnose(classtable, cur_class, NEW_CLASS_ERROR, type_name);
+        return poison_type(this);
+    }
+    record_call(NEW_CALL, created->second, NULL);
+    type = type_name;
+    record_void_source(this, type, NEVER_VOID);
+    return type_name;
+}
+
+Symbol isvoid_class::get_expression_type(Class_ cur_class)
+{
+    e1->get_expression_type(cur_class);
+    void_check_operands.push_back(e1);
+    type = Bool;
+    record_void_source(this, type, NEVER_VOID);
+    return Bool;
+}
+
+Symbol no_expr_class::get_expression_type(Class_ cur_class)
+{
+    type = No_type;
+    record_void_source(this, type, MAYBE_VOID);
+    return No_type;
+}
+
+Symbol object_class::get_expression_type(Class_ cur_class)
+{
+    if(name == self)
+    {
+        type = SELF_TYPE;
+        record_void_source(this, type, NEVER_VOID);
+        return type;
+    }
+    Symbol* obj_type = attribute_table->lookup(name);
+    if(obj_type==NULL)
+    {
+        diagnose(classtable, cur_class, UNDEFINED_IDENTIFIER_ERROR, name);
+        return poison_type(this);
+    }
+    if(*obj_type==poison)
+        return poison_type(this);
+    type = *obj_type;
+    record_void_source(this, type, local_source(obj_type));
+    return type;
+}
+
+void method_class::check_feature(Class_ cur_class)
+{
+    bool err_flag=false;
+    for(int i=formals->first();formals->more(i);i=formals->next(i))
+    {
+        Formal formal = formals->nth(i);
+        Symbol formal_name = formal->get_name();
+        if(formal_name == self)
+        {
+            diagnose(classtable, cur_class, SELF_FORMAL_ERROR);
+            err_flag=true;
+        }
+        if(inheritance_graph.find(formal->get_type())==inheritance_graph.end())
+        {
+            diagnose(classtable, cur_class, FORMAL_TYPE_ERROR, formal->get_type(), formal_name);
+            err_flag=true;   
+        }
+        if(attribute_table->probe(formal_name)!=NULL)
+        {
+            diagnose(classtable, cur_class, FORMAL_REDEFINED_ERROR, formal_name);
+            err_flag=true;
+        }
+        if(!err_flag)
+        {
+            attribute_table->addid(formal_name, new Symbol(formal->get_type()));
+        }
+    }
+    Symbol expr_type=expr->get_expression_type(cur_class);
+    Symbol r_type = return_type;
+    if(r_type==SELF_TYPE)
+        r_type=cur_class->get_name();
+    if(expr_type==SELF_TYPE)
+        expr_type=cur_class->get_name();
+    if(expr_type!=poison && expr_type!=return_type && (!subClass(expr_type,return_type)))
+    {
+        diagnose(classtable, cur_class, RETURN_TYPE_ERROR, expr_type, name, return_type);
+    }
+
+
+}
+
+void attr_class::check_feature(Class_ cur_class)
+{
+    Symbol assigned_type = init->get_expression_type(cur_class);
+    if(assigned_type==SELF_TYPE)
+        assigned_type=cur_class->get_name();
+    Symbol decl_type = type_decl;
+    if(decl_type==SELF_TYPE)
+        decl_type=cur_class->get_name();
+    if(inheritance_graph.find(decl_type)==inheritance_graph.end())
+    {
+        diagnose(classtable, cur_class, ATTR_TYPE_ERROR, type_decl, name);
+    }
+
+    if(assigned_type!=No_type && assigned_type!=poison && assigned_type!=type_decl && (!subClass(assigned_type,type_decl)))
+    {
+        diagnose(classtable, cur_class, ATTR_INIT_ERROR, assigned_type, name, type_decl);
+    }
+}
+
+void method_class::check_declaration(Class_ cur_class)
+{
+    if(cur_class->find_method(name)!=this)
+    {
+        declaration_error_in(cur_class, METHOD_REDEFINED_ERROR, name);
+        return;
+    }
+
+    std::map<Symbol, Class_>::iterator parent = inheritance_graph.find(cur_class->get_parent());
+    Feature inherited_feature = parent==inheritance_graph.end() ? NULL : getmethods(parent->second, name);
+    if(inherited_feature!=NULL)
+    {
+        int inherited_id = intern_signature(inherited_feature);
+        int id = intern_signature(this);
+
+        /* only a mismatch needs the types compared one by one, to say what differs. */
+        if(id!=inherited_id)
+        {
+            method_signature mine = signatures[id];
+            method_signature inherited = signatures[inherited_id];
+            if(mine.arity!=inherited.arity)
+            {
+                declaration_error_in(cur_class, OVERRIDE_FORMALS_COUNT_ERROR, name);
+                return;
+            }
+
+            for(unsigned int i=0; i<mine.arity; i++)
+            {
+                Symbol formal_type = signature_types[mine.offset + i];
+                Symbol inherited_type = signature_types[inherited.offset + i];
+                if(formal_type!=inherited_type)
+                {
+                    declaration_error_in(cur_class, OVERRIDE_FORMAL_TYPE_ERROR, name, formal_type, inherited_type);
+                    break;
+                }
+            }
+
+            if(return_type!=inherited_feature->get_return_type())
+            {
+                declaration_error_in(cur_class, OVERRIDE_RETURN_TYPE_ERROR, name, return_type, inherited_feature->get_return_type());
+                return;
+            }
+        }
+    }
+}
+
+/* methods are found through the feature indexes, so they take no scope entry. */
+void method_class::add_to_symbol_table(Feature, Class_)
+{
+}
+
+/* true if a proper ancestor of `c' defines attribute `name'. */
+static bool inherits_attr(Class_ c, Symbol name)
+{
+    for(;;)
+    {
+        std::map<Symbol, Class_>::iterator parent = inheritance_graph.find(c->get_parent());
+        if(parent==inheritance_graph.end())
+            return false;
+        c = parent->second;
+        if(c->find_attr(name)!=NULL)
+            return true;
+    }
+}
+
+void attr_class::check_declaration(Class_ cur_class)
+{
+    diagnostic_code code;
+    if(cur_class->find_attr(name)!=this)
+        code = ATTR_REDEFINED_ERROR;
+    else if(inherits_attr(cur_class, name))
+        code = INHERITED_ATTR_ERROR;
+    else if(name==self)
+        code = SELF_ATTR_ERROR;
+    else
+        return;
+    declaration_error_in(cur_class, code, code==SELF_ATTR_ERROR ? NULL : name);
+    rejected_attrs.insert(this);
+}
+
+void attr_class::add_to_symbol_table(Feature current_feature, Class_ cur_class)
+{
+    if(rejected_attrs.find(current_feature)!=rejected_attrs.end())
+        return;
+    if(type_decl==SELF_TYPE){
+        attribute_table->addid(name, new Symbol(cur_class->get_name()));
+        return;
+    }    
+    attribute_table->addid(name, new Symbol(type_decl));
+}
+
+void populate_symbol_tables(Class_ cur_class)
+{
+    Symbol parent = cur_class->get_parent();
+    if(parent!=No_class)
+    {
+        populate_symbol_tables(inheritance_graph.find(parent)->second);
+    }
+
+    attribute_table->enterscope();
+
+    Features features = cur_class->get_features();
+
+    for(int i=features->first(); features->more(i); i=features->next(i))
+    {
+        Feature feature = features->nth(i);
+        feature->add_to_symbol_table(features->nth(i), cur_class);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// traverse visits a node and then each of its children in order,
+// passing the size of every node to the visitor.  A list is visited
+// as a single node covering its append-tree spine.
+//
+//////////////////////////////////////////////////////////////////////
+
+template <class Elem>
+static void traverse_list(list_node<Elem> *list, tree_visitor visit, void *data)
+{
+    size_t spine = sizeof(nil_node<Elem>) +
+        list->len() * (sizeof(single_list_node<Elem>) + sizeof(append_node<Elem>));
+    visit(list, spine, data);
+    for(int i=list->first(); list->more(i); i=list->next(i))
+        list->nth(i)->traverse(visit, data);
+}
+
+void program_class::traverse(tree_visitor visit, void *data)
+{
+    visit(this, sizeof(*this), data);
+    traverse_list(classes, visit, data);
+}
+
+void class__class::traverse(tree_visitor visit, void *data)
+{
+    visit(this, sizeof(*this), data);
+    traverse_list(features, visit, data);
+}
+
+void method_class::traverse(tree_visitor visit, void *data)
+{
+    visit(this, sizeof(*this), data);
+    traverse_list(formals, visit, data);
+    expr->traverse(visit, data);
+}
+
+void attr_class::traverse(tree_visitor visit, void *data)
+{
+    visit(this, sizeof(*this), data);
+    init->traverse(visit, data);
+}
+
+void formal_class::traverse(tree_visitor visit, void *data)
+{
+    visit(this, sizeof(*this), data);
+}
+
+void branch_class::traverse(tree_visitor visit, void *data)
+{
+    visit(this, sizeof(*this), data);
+    expr->traverse(visit, data);
+}
+
+void assign_class::traverse(tree_visitor visit, void *data)
+{
+    visit(this, sizeof(*this), data);
+    expr->traverse(visit, data);
+}
+
+void static_dispatch_class::traverse(tree_visitor visit, void *data)
+{
+    visit(this, sizeof(*this), data);
+    expr->traverse(visit, data);
+    traverse_list(actual, visit, data);
+}
+
+void dispatch_class::traverse(tree_visitor visit, void *data)
+{
+    visit(this, sizeof(*this), data);
+    expr->traverse(visit, data);
+    traverse_list(actual, visit, data);
+}
+
+void cond_class::traverse(tree_visitor visit, void *data)
+{
+    visit(this, sizeof(*this), data);
+    pred->traverse(visit, data);
+    then_exp->traverse(visit, data);
+    else_exp->traverse(visit, data);
+}
+
+void loop_class::traverse(tree_visitor visit, void *data)
+{
+    visit(this, sizeof(*this), data);
+    pred->traverse(visit, data);
+    body->traverse(visit, data);
+}
+
+void typcase_class::traverse(tree_visitor visit, void *data)
+{
+    visit(this, sizeof(*this), data);
+    expr->traverse(visit, data);
+    traverse_list(cases, visit, data);
+}
+
+void block_class::traverse(tree_visitor visit, void *data)
+{
+    visit(this, sizeof(*this), data);
+    traverse_list(body, visit, data);
+}
+
+void let_class::traverse(tree_visitor visit, void *data)
+{
+    visit(this, sizeof(*this), data);
+    init->traverse(visit, data);
+    body->traverse(visit, data);
+}
+
+void plus_class::traverse(tree_visitor visit, void *data)
+{
+    visit(this, sizeof(*this), data);
+    e1->traverse(visit, data);
+    e2->traverse(visit, data);
+}
+
+void sub_class::traverse(tree_visitor visit, void *data)
+{
+    visit(this, sizeof(*this), data);
+    e1->traverse(visit, data);
+    e2->traverse(visit, data);
+}
+
+void mul_class::traverse(tree_visitor visit, void *data)
+{
+    visit(this, sizeof(*this), data);
+    e1->traverse(visit, data);
+    e2->traverse(visit, data);
+}
+
+void divide_class::traverse(tree_visitor visit, void *data)
+{
+    visit(this, sizeof(*this), data);
+    e1->traverse(visit, data);
+    e2->traverse(visit, data);
+}
+
+void neg_class::traverse(tree_visitor visit, void *data)
+{
+    visit(this, sizeof(*this), data);
+    e1->traverse(visit, data);
+}
+
+void lt_class::traverse(tree_visitor visit, void *data)
+{
+    visit(this, sizeof(*this), data);
+    e1->traverse(visit, data);
+    e2->traverse(visit, data);
+}
+
+void eq_class::traverse(tree_visitor visit, void *data)
+{
+    visit(this, sizeof(*this), data);
+    e1->traverse(visit, data);
+    e2->traverse(visit, data);
+}
+
+void leq_class::traverse(tree_visitor visit, void *data)
+{
+    visit(this, sizeof(*this), data);
+    e1->traverse(visit, data);
+    e2->traverse(visit, data);
+}
+
+void comp_class::traverse(tree_visitor visit, void *data)
+{
+    visit(this, sizeof(*this), data);
+    e1->traverse(visit, data);
+}
+
+void int_const_class::traverse(tree_visitor visit, void *data)
+{
+    visit(this, sizeof(*this), data);
+}
+
+void bool_const_class::traverse(tree_visitor visit, void *data)
+{
+    visit(this, sizeof(*this), data);
+}
+
+void string_const_class::traverse(tree_visitor visit, void *data)
+{
+    visit(this, sizeof(*this), data);
+}
+
+void new__class::traverse(tree_visitor visit, void *data)
+{
+    visit(this, sizeof(*this), data);
+}
+
+void isvoid_class::traverse(tree_visitor visit, void *data)
+{
+    visit(this, sizeof(*this), data);
+    e1->traverse(visit, data);
+}
+
+void no_expr_class::traverse(tree_visitor visit, void *data)
+{
+    visit(this, sizeof(*this), data);
+}
+
+void object_class::traverse(tree_visitor visit, void *data)
+{
+    visit(this, sizeof(*this), data);
+}
+
+/* an estimate of the red-black tree bookkeeping behind each std::map entry. */
+static const size_t map_node_overhead = 4 * sizeof(void *);
+
+//////////////////////////////////////////////////////////////////////
+//
+// Compact AST
+//
+// A CompactAst holds a tree in flat arrays instead of heap nodes.  A
+// node is a one byte kind, a line number and up to four 32-bit
+// operands; an operand is the index of a child node, the handle of a
+// list, a symbol id or a constant.  Nodes are numbered in preorder.
+// Symbols are numbered in the order they are first seen, with id 0
+// standing for no symbol, and the decorated type of every expression
+// is kept as a symbol id in a parallel array.
+//
+// compact() copies a tree into the store.  materialize() goes the
+// other way and rebuilds cool-tree nodes for the checker, which only
+// runs on cool-tree nodes: a second checker over the arrays would
+// duplicate every typing rule.  store_annotations() then copies the
+// types and the other annotations of the checked tree back into the
+// store's parallel arrays.
+//
+//////////////////////////////////////////////////////////////////////
+
+CompactAst::CompactAst()
+{
+    symbols.push_back(NULL);
+    symbol_tables.push_back(ID_SYMBOL);
+}
+
+unsigned int CompactAst::add_node(compact_kind kind, int line)
+{
+    compact_operands none = { 0, 0, 0, 0 };
+    kinds.push_back(kind);
+    lines.push_back(line);
+    operands.push_back(none);
+    types.push_back(0);
+    return kinds.size() - 1;
+}
+
+void CompactAst::set_operands(unsigned int node, unsigned int a, unsigned int b,
+                              unsigned int c, unsigned int d)
+{
+    compact_operands op = { a, b, c, d };
+    operands[node] = op;
+}
+
+void CompactAst::set_type(unsigned int node, Symbol type)
+{
+    types[node] = symbol_id(type, ID_SYMBOL);
+}
+
+unsigned int CompactAst::symbol_id(Symbol sym, symbol_table_kind table)
+{
+    if(sym==NULL)
+        return 0;
+    std::map<Symbol, unsigned int>::iterator it = symbol_ids.find(sym);
+    if(it!=symbol_ids.end())
+        return it->second;
+    unsigned int id = symbols.size();
+    symbols.push_back(sym);
+    symbol_tables.push_back(table);
+    symbol_ids.insert(std::pair<Symbol, unsigned int>(sym, id));
+    return id;
+}
+
+template <class Elem>
+unsigned int CompactAst::add_list(list_node<Elem> *list)
+{
+    unsigned int handle = list_items.size();
+    unsigned int length = list->len();
+    list_items.resize(handle + 1 + length);
+    list_items[handle] = length;
+
+    unsigned int n = 0;
+    for(int i=list->first(); list->more(i); i=list->next(i))
+    {
+        /* compacting the element may grow list_items, so index it afterwards. */
+        unsigned int element = list->nth(i)->compact(*this);
+        list_items[handle + 1 + n++] = element;
+    }
+    return handle;
+}
+
+/* a list of nodes that are already in the store. */
+unsigned int CompactAst::add_list(const std::vector<unsigned int> &items)
+{
+    unsigned int handle = list_items.size();
+    list_items.push_back(items.size());
+    list_items.insert(list_items.end(), items.begin(), items.end());
+    return handle;
+}
+
+size_t CompactAst::bytes()
+{
+    return kinds.capacity() * sizeof(unsigned char) +
+        lines.capacity() * sizeof(unsigned int) +
+        operands.capacity() * sizeof(compact_operands) +
+        types.capacity() * sizeof(unsigned int) +
+        list_items.capacity() * sizeof(unsigned int) +
+        symbols.capacity() * sizeof(Symbol) +
+        symbol_tables.capacity() * sizeof(unsigned char) +
+        symbol_ids.size() * (sizeof(std::pair<const Symbol, unsigned int>) + map_node_overhead) +
+        materialized.capacity() * sizeof(tree_node *) +
+        void_sources.capacity() * sizeof(int) +
+        constants.capacity() * sizeof(int) +
+        folded.capacity() / 8 +
+        known_preds.size() * (sizeof(std::pair<const unsigned int, int>) + map_node_overhead) +
+        targets.size() * (sizeof(std::pair<const unsigned int, std::pair<Feature, Class_> >) + map_node_overhead) +
+        sorted_cases.size() * (sizeof(std::pair<const unsigned int, unsigned int>) + map_node_overhead);
+}
+
+unsigned int program_class::compact(CompactAst &ast)
+{
+    unsigned int node = ast.add_node(PROGRAM_NODE, line_number);
+    unsigned int list = ast.add_list(classes);
+    ast.set_operands(node, list);
+    return node;
+}
+
+unsigned int class__class::compact(CompactAst &ast)
+{
+    unsigned int node = ast.add_node(CLASS_NODE, line_number);
+    unsigned int list = ast.add_list(features);
+    ast.set_operands(node, ast.symbol_id(name, ID_SYMBOL), ast.symbol_id(parent, ID_SYMBOL),
+                     list, ast.symbol_id(filename, STRING_SYMBOL));
+    return node;
+}
+
+unsigned int method_class::compact(CompactAst &ast)
+{
+    unsigned int node = ast.add_node(METHOD_NODE, line_number);
+    unsigned int list = ast.add_list(formals);
+    unsigned int body = expr->compact(ast);
+    ast.set_operands(node, ast.symbol_id(name, ID_SYMBOL), list,
+                     ast.symbol_id(return_type, ID_SYMBOL), body);
+    return node;
+}
+
+unsigned int attr_class::compact(CompactAst &ast)
+{
+    unsigned int node = ast.add_node(ATTR_NODE, line_number);
+    unsigned int init_node = init->compact(ast);
+    ast.set_operands(node, ast.symbol_id(name, ID_SYMBOL), ast.symbol_id(type_decl, ID_SYMBOL), init_node);
+    return node;
+}
+
+unsigned int formal_class::compact(CompactAst &ast)
+{
+    unsigned int node = ast.add_node(FORMAL_NODE, line_number);
+    ast.set_operands(node, ast.symbol_id(name, ID_SYMBOL), ast.symbol_id(type_decl, ID_SYMBOL));
+    return node;
+}
+
+unsigned int branch_class::compact(CompactAst &ast)
+{
+    unsigned int node = ast.add_node(BRANCH_NODE, line_number);
+    unsigned int body = expr->compact(ast);
+    ast.set_operands(node, ast.symbol_id(name, ID_SYMBOL), ast.symbol_id(type_decl, ID_SYMBOL), body);
+    return node;
+}
+
+unsigned int assign_class::compact(CompactAst &ast)
+{
+    unsigned int node = ast.add_node(ASSIGN_NODE, line_number);
+    unsigned int value = expr->compact(ast);
+    ast.set_operands(node, ast.symbol_id(name, ID_SYMBOL), value);
+    ast.set_type(node, type);
+    return node;
+}
+
+unsigned int static_dispatch_class::compact(CompactAst &ast)
+{
+    unsigned int node = ast.add_node(STATIC_DISPATCH_NODE, line_number);
+    unsigned int receiver = expr->compact(ast);
+    unsigned int list = ast.add_list(actual);
+    ast.set_operands(node, receiver, ast.symbol_id(type_name, ID_SYMBOL), ast.symbol_id(name, ID_SYMBOL), list);
+    ast.set_type(node, type);
+    return node;
+}
+
+unsigned int dispatch_class::compact(CompactAst &ast)
+{
+    unsigned int node = ast.add_node(DISPATCH_NODE, line_number);
+    unsigned int receiver = expr->compact(ast);
+    unsigned int list = ast.add_list(actual);
+    ast.set_operands(node, receiver, ast.symbol_id(name, ID_SYMBOL), list);
+    ast.set_type(node, type);
+    return node;
+}
+
+unsigned int cond_class::compact(CompactAst &ast)
+{
+    unsigned int node = ast.add_node(COND_NODE, line_number);
+    unsigned int pred_node = pred->compact(ast);
+    unsigned int then_node = then_exp->compact(ast);
+    unsigned int else_node = else_exp->compact(ast);
+    ast.set_operands(node, pred_node, then_node, else_node);
+    ast.set_type(node, type);
+    return node;
+}
+
+unsigned int loop_class::compact(CompactAst &ast)
+{
+    unsigned int node = ast.add_node(LOOP_NODE, line_number);
+    unsigned int pred_node = pred->compact(ast);
+    unsigned int body_node = body->compact(ast);
+    ast.set_operands(node, pred_node, body_node);
+    ast.set_type(node, type);
+    return node;
+}
+
+unsigned int typcase_class::compact(CompactAst &ast)
+{
+    unsigned int node = ast.add_node(TYPCASE_NODE, line_number);
+    unsigned int scrutinee = expr->compact(ast);
+    unsigned int list = ast.add_list(cases);
+    ast.set_operands(node, scrutinee, list);
+    ast.set_type(node, type);
+    return node;
+}
+
+unsigned int block_class::compact(CompactAst &ast)
+{
+    unsigned int node = ast.add_node(BLOCK_NODE, line_number);
+    unsigned int list = ast.add_list(body);
+    ast.set_operands(node, list);
+    ast.set_type(node, type);
+    return node;
+}
+
+unsigned int let_class::compact(CompactAst &ast)
+{
+    unsigned int node = ast.add_node(LET_NODE, line_number);
+    unsigned int init_node = init->compact(ast);
+    unsigned int body_node = body->compact(ast);
+    ast.set_operands(node, ast.symbol_id(identifier, ID_SYMBOL), ast.symbol_id(type_decl, ID_SYMBOL),
+                     init_node, body_node);
+    ast.set_type(node, type);
+    return node;
+}
+
+static unsigned int compact_binary(CompactAst &ast, compact_kind kind, int line, Symbol type,
+                                   Expression e1, Expression e2)
+{
+    unsigned int node = ast.add_node(kind, line);
+    unsigned int left = e1->compact(ast);
+    unsigned int right = e2->compact(ast);
+    ast.set_operands(node, left, right);
+    ast.set_type(node, type);
+    return node;
+}
+
+static unsigned int compact_unary(CompactAst &ast, compact_kind kind, int line, Symbol type,
+                                  Expression e1)
+{
+    unsigned int node = ast.add_node(kind, line);
+    unsigned int operand = e1->compact(ast);
+    ast.set_operands(node, operand);
+    ast.set_type(node, type);
+    return node;
+}
+
+unsigned int plus_class::compact(CompactAst &ast)
+{
+    return compact_binary(ast, PLUS_NODE, line_number, type, e1, e2);
+}
+
+unsigned int sub_class::compact(CompactAst &ast)
+{
+    return compact_binary(ast, SUB_NODE, line_number, type, e1, e2);
+}
+
+unsigned int mul_class::compact(CompactAst &ast)
+{
+    return compact_binary(ast, MUL_NODE, line_number, type, e1, e2);
+}
+
+unsigned int divide_class::compact(CompactAst &ast)
+{
+    return compact_binary(ast, DIVIDE_NODE, line_number, type, e1, e2);
+}
+
+unsigned int neg_class::compact(CompactAst &ast)
+{
+    return compact_unary(ast, NEG_NODE, line_number, type, e1);
+}
+
+unsigned int lt_class::compact(CompactAst &ast)
+{
+    return compact_binary(ast, LT_NODE, line_number, type, e1, e2);
+}
+
+unsigned int eq_class::compact(CompactAst &ast)
+{
+    return compact_binary(ast, EQ_NODE, line_number, type, e1, e2);
+}
+
+unsigned int leq_class::compact(CompactAst &ast)
+{
+    return compact_binary(ast, LEQ_NODE, line_number, type, e1, e2);
+}
+
+unsigned int comp_class::compact(CompactAst &ast)
+{
+    return compact_unary(ast, COMP_NODE, line_number, type, e1);
+}
+
+unsigned int int_const_class::compact(CompactAst &ast)
+{
+    unsigned int node = ast.add_node(INT_CONST_NODE, line_number);
+    ast.set_operands(node, ast.symbol_id(token, INT_SYMBOL));
+    ast.set_type(node, type);
+    return node;
+}
+
+unsigned int bool_const_class::compact(CompactAst &ast)
+{
+    unsigned int node = ast.add_node(BOOL_CONST_NODE, line_number);
+    ast.set_operands(node, val ? 1 : 0);
+    ast.set_type(node, type);
+    return node;
+}
+
+unsigned int string_const_class::compact(CompactAst &ast)
+{
+    unsigned int node = ast.add_node(STRING_CONST_NODE, line_number);
+    ast.set_operands(node, ast.symbol_id(token, STRING_SYMBOL));
+    ast.set_type(node, type);
+    return node;
+}
+
+unsigned int new__class::compact(CompactAst &ast)
+{
+    unsigned int node = ast.add_node(NEW_NODE, line_number);
+    ast.set_operands(node, ast.symbol_id(type_name, ID_SYMBOL));
+    ast.set_type(node, type);
+    return node;
+}
+
+unsigned int isvoid_class::compact(CompactAst &ast)
+{
+    return compact_unary(ast, ISVOID_NODE, line_number, type, e1);
+}
+
+unsigned int no_expr_class::compact(CompactAst &ast)
+{
+    unsigned int node = ast.add_node(NO_EXPR_NODE, line_number);
+    ast.set_type(node, type);
+    return node;
+}
+
+unsigned int object_class::compact(CompactAst &ast)
+{
+    unsigned int node = ast.add_node(OBJECT_NODE, line_number);
+    ast.set_operands(node, ast.symbol_id(name, ID_SYMBOL));
+    ast.set_type(node, type);
+    return node;
+}
+
+/*
+   The constructors take their line number from node_lineno, so it is
+   set right before each node is built, after its children.
+ */
+tree_node *CompactAst::built(unsigned int node, tree_node *t)
+{
+    materialized[node] = t;
+    return t;
+}
+
+Program CompactAst::materialize(unsigned int root)
+{
+    materialized.assign(kinds.size(), NULL);
+    Classes classes = materialize_classes(operands[root].a);
+    node_lineno = lines[root];
+    return (Program) built(root, program(classes));
+}
+
+Class_ CompactAst::materialize_class(unsigned int node)
+{
+    compact_operands op = operands[node];
+    Features features = materialize_features(op.c);
+    node_lineno = lines[node];
+    return (Class_) built(node, class_(symbols[op.a], symbols[op.b], features, symbols[op.d]));
+}
+
+Feature CompactAst::materialize_feature(unsigned int node)
+{
+    compact_operands op = operands[node];
+    if(kinds[node]==METHOD_NODE)
+    {
+        Formals formals = materialize_formals(op.b);
+        Expression body = materialize_expression(op.d);
+        node_lineno = lines[node];
+        return (Feature) built(node, method(symbols[op.a], formals, symbols[op.c], body));
+    }
+    Expression init = materialize_expression(op.c);
+    node_lineno = lines[node];
+    return (Feature) built(node, attr(symbols[op.a], symbols[op.b], init));
+}
+
+Formal CompactAst::materialize_formal(unsigned int node)
+{
+    compact_operands op = operands[node];
+    node_lineno = lines[node];
+    return (Formal) built(node, formal(symbols[op.a], symbols[op.b]));
+}
+
+Case CompactAst::materialize_case(unsigned int node)
+{
+    compact_operands op = operands[node];
+    Expression body = materialize_expression(op.c);
+    node_lineno = lines[node];
+    return (Case) built(node, branch(symbols[op.a], symbols[op.b], body));
+}
+
+Expression CompactAst::materialize_expression(unsigned int node)
+{
+    compact_operands op = operands[node];
+    Expression e1 = NULL, e2 = NULL, e3 = NULL, e = NULL;
+    Expressions list;
+    Cases cases;
+
+    switch(kinds[node])
+    {
+    case ASSIGN_NODE:
+        e1 = materialize_expression(op.b);
+        node_lineno = lines[node];
+        e = assign(symbols[op.a], e1);
+        break;
+    case STATIC_DISPATCH_NODE:
+        e1 = materialize_expression(op.a);
+        list = materialize_expressions(op.d);
+        node_lineno = lines[node];
+        e = static_dispatch(e1, symbols[op.b], symbols[op.c], list);
+        break;
+    case DISPATCH_NODE:
+        e1 = materialize_expression(op.a);
+        list = materialize_expressions(op.c);
+        node_lineno = lines[node];
+        e = dispatch(e1, symbols[op.b], list);
+        break;
+    case COND_NODE:
+        e1 = materialize_expression(op.a);
+        e2 = materialize_expression(op.b);
+        e3 = materialize_expression(op.c);
+        node_lineno = lines[node];
+        e = cond(e1, e2, e3);
+        break;
+    case LOOP_NODE:
+        e1 = materialize_expression(op.a);
+        e2 = materialize_expression(op.b);
+        node_lineno = lines[node];
+        e = loop(e1, e2);
+        break;
+    case TYPCASE_NODE:
+        e1 = materialize_expression(op.a);
+        cases = materialize_cases(op.b);
+        node_lineno = lines[node];
+        e = typcase(e1, cases);
+        break;
+    case BLOCK_NODE:
+        list = materialize_expressions(op.a);
+        node_lineno = lines[node];
+        e = block(list);
+        break;
+    case LET_NODE:
+        e1 = materialize_expression(op.c);
+        e2 = materialize_expression(op.d);
+        node_lineno = lines[node];
+        e = let(symbols[op.a], symbols[op.b], e1, e2);
+        break;
+    case PLUS_NODE:
+    case SUB_NODE:
+    case MUL_NODE:
+    case DIVIDE_NODE:
+    case LT_NODE:
+    case EQ_NODE:
+    case LEQ_NODE:
+        e1 = materialize_expression(op.a);
+        e2 = materialize_expression(op.b);
+        node_lineno = lines[node];
+        switch(kinds[node])
+        {
+        case PLUS_NODE:   e = plus(e1, e2); break;
+        case SUB_NODE:    e = sub(e1, e2); break;
+        case MUL_NODE:    e = mul(e1, e2); break;
+        case DIVIDE_NODE: e = divide(e1, e2); break;
+        case LT_NODE:     e = lt(e1, e2); break;
+        case EQ_NODE:     e = eq(e1, e2); break;
+        default:          e = leq(e1, e2); break;
+        }
+        break;
+    case NEG_NODE:
+    case COMP_NODE:
+    case ISVOID_NODE:
+        e1 = materialize_expression(op.a);
+        node_lineno = lines[node];
+        switch(kinds[node])
+        {
+        case NEG_NODE:  e = neg(e1); break;
+        case COMP_NODE: e = comp(e1); break;
+        default:        e = isvoid(e1); break;
+        }
+        break;
+    case INT_CONST_NODE:
+        node_lineno = lines[node];
+        e = int_const(symbols[op.a]);
+        break;
+    case BOOL_CONST_NODE:
+        node_lineno = lines[node];
+        e = bool_const(op.a);
+        break;
+    case STRING_CONST_NODE:
+        node_lineno = lines[node];
+        e = string_const(symbols[op.a]);
+        break;
+    case NEW_NODE:
+        node_lineno = lines[node];
+        e = new_(symbols[op.a]);
+        break;
+    case OBJECT_NODE:
+        node_lineno = lines[node];
+        e = object(symbols[op.a]);
+        break;
+    default:
+        node_lineno = lines[node];
+        e = no_expr();
+        break;
+    }
+    e->set_type(symbols[types[node]]);
+    return (Expression) built(node, e);
+}
+
+Classes CompactAst::materialize_classes(unsigned int list)
+{
+    Classes classes = nil_Classes();
+    for(unsigned int i=0; i<list_length(list); i++)
+        classes = append_Classes(classes, single_Classes(materialize_class(list_item(list, i))));
+    return classes;
+}
+
+Features CompactAst::materialize_features(unsigned int list)
+{
+    Features features = nil_Features();
+    for(unsigned int i=0; i<list_length(list); i++)
+        features = append_Features(features, single_Features(materialize_feature(list_item(list, i))));
+    return features;
+}
+
+Formals CompactAst::materialize_formals(unsigned int list)
+{
+    Formals formals = nil_Formals();
+    for(unsigned int i=0; i<list_length(list); i++)
+        formals = append_Formals(formals, single_Formals(materialize_formal(list_item(list, i))));
+    return formals;
+}
+
+Cases CompactAst::materialize_cases(unsigned int list)
+{
+    Cases cases = nil_Cases();
+    for(unsigned int i=0; i<list_length(list); i++)
+        cases = append_Cases(cases, single_Cases(materialize_case(list_item(list, i))));
+    return cases;
+}
+
+Expressions CompactAst::materialize_expressions(unsigned int list)
+{
+    Expressions expressions = nil_Expressions();
+    for(unsigned int i=0; i<list_length(list); i++)
+        expressions = append_Expressions(expressions, single_Expressions(materialize_expression(list_item(list, i))));
+    return expressions;
+}
+
+/*
+   Copies what checking left on the materialized expressions into the
+   store: the types, void sources and folded constants, the constant
+   predicates, the monomorphic dispatch targets and the sorted case
+   branches.
+ */
+void CompactAst::store_annotations()
+{
+    void_sources.assign(kinds.size(), MAYBE_VOID);
+    constants.assign(kinds.size(), 0);
+    folded.assign(kinds.size(), false);
+    known_preds.clear();
+    targets.clear();
+    sorted_cases.clear();
+
+    std::map<tree_node *, unsigned int> branch_nodes;
+    for(unsigned int node=0; node<materialized.size(); node++)
+    {
+        if(materialized[node]!=NULL && kinds[node]==BRANCH_NODE)
+            branch_nodes[materialized[node]] = node;
+    }
+
+    for(unsigned int node=0; node<materialized.size(); node++)
+    {
+        if(materialized[node]==NULL || kinds[node]<ASSIGN_NODE)
+            continue;
+        Expression e = static_cast<Expression>(materialized[node]);
+        set_type(node, e->get_type());
+        void_sources[node] = e->get_void_source();
+        int value;
+        if(e->get_constant(value))
+        {
+            folded[node] = true;
+            constants[node] = value;
+        }
+
+        int pred = -1;
+        if(kinds[node]==COND_NODE)
+            pred = static_cast<cond_class *>(e)->get_known_pred();
+        else if(kinds[node]==LOOP_NODE)
+            pred = static_cast<loop_class *>(e)->get_known_pred();
+        if(pred!=-1)
+            known_preds[node] = pred;
+
+        if(kinds[node]==DISPATCH_NODE)
+        {
+            dispatch_class *call = static_cast<dispatch_class *>(e);
+            if(call->get_target()!=NULL)
+                targets[node] = std::pair<Feature, Class_>(call->get_target(), call->get_target_class());
+        }
+        else if(kinds[node]==TYPCASE_NODE)
+        {
+            const std::vector<Case> &branches = static_cast<typcase_class *>(e)->get_sorted_cases();
+            std::vector<unsigned int> sorted;
+            for(size_t i=0; i<branches.size(); i++)
+                sorted.push_back(branch_nodes[branches[i]]);
+            if(!sorted.empty())
+                sorted_cases[node] = add_list(sorted);
+        }
+    }
+}
+
+/* the store of the program semant_compact is checking, for the report. */
+static CompactAst *compact_store = NULL;
+
+//////////////////////////////////////////////////////////////////////
+//
+// Concurrent symbol interning
+//
+// idtable, inttable and stringtable may only be used by one thread at a
+// time, and every lookup in them is a linear scan.  SymbolInterner
+// sits in front of them for the AST readers.  It is split by hash into
+// shards.  Each shard is an open-addressing table of (hash, Symbol)
+// with its own lock, so threads interning different strings rarely
+// wait on each other.  Only a string that was never seen before goes
+// on to its string table, under one lock shared by all shards.  That
+// keeps Symbols unique: interning a string here returns the same Entry
+// that add_string on the string table returns.
+//
+// Code that calls the string tables directly, such as
+// initialize_constants and install_basic_classes, must not run while
+// readers are running.
+//
+// hash_text consumes 16 bytes per step as two 64-bit lanes, each adding
+// the product of its keyed 32-bit halves and the other lane, so one
+// step is a handful of SSE2 instructions instead of sixteen dependent
+// multiplies.  same_text compares 16 (with AVX2, 32) bytes per step.
+// Both have a scalar version that computes the same result; building
+// with -DSEMANT_NO_SIMD selects it.
+//
+//////////////////////////////////////////////////////////////////////
+
+static const unsigned long long hash_secret[2] = { 0x9e3779b185ebca87ULL, 0xc2b2ae3d27d4eb4fULL };
+static const unsigned long long hash_block_step = 0x165667b19e3779f9ULL;
+
+static unsigned long long load64(const char *p)
+{
+    unsigned long long v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static unsigned long long load32(const char *p)
+{
+    unsigned int v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/* mixes the 16-byte block `data', the `block'th of the text, into the two lanes. */
+static void hash_block(unsigned long long acc[2], const unsigned long long data[2], int block)
+{
+    for(int lane=0; lane<2; lane++)
+    {
+        unsigned long long keyed = data[lane] ^ hash_secret[lane] ^ (block * hash_block_step);
+        acc[lane] += (keyed & 0xffffffffULL) * (keyed >> 32) + data[lane ^ 1];
+    }
+}
+
+/*
+   The last 0 to 16 bytes as a block.  Overlapping loads cover them
+   without copying, and no load reaches past the end of the text.
+ */
+static void hash_tail(const char *p, int n, unsigned long long data[2])
+{
+    data[1] = 0;
+    if(n>8)
+    {
+        data[0] = load64(p);
+        data[1] = load64(p + n - 8);
+    }
+    else if(n>=4)
+        data[0] = (load32(p) << 32) | load32(p + n - 4);
+    else if(n>0)
+        data[0] = ((unsigned long long) (unsigned char) p[0] << 16) |
+                  ((unsigned long long) (unsigned char) p[n >> 1] << 8) | (unsigned char) p[n - 1];
+    else
+        data[0] = 0;
+}
+
+/* the finished hash of the two lanes; `length' keeps tails of different lengths apart. */
+static unsigned int hash_finish(const unsigned long long acc[2], int length)
+{
+    unsigned long long h = acc[0] ^ ((acc[1] << 31) | (acc[1] >> 33)) ^ (length * 0x9e3779b97f4a7c15ULL);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return (unsigned int) h;
+}
+
+static unsigned int hash_text(const char *text, int length)
+{
+    unsigned long long acc[2] = { 0, 0 };
+    int blocks = (length - 1) / 16;
+#ifdef SEMANT_SIMD
+    if(blocks>0)
+    {
+        const __m128i secret = _mm_set_epi64x(hash_secret[1], hash_secret[0]);
+        __m128i lanes = _mm_setzero_si128();
+        for(int i=0; i<blocks; i++)
+        {
+            __m128i data = _mm_loadu_si128((const __m128i *) (text + 16 * i));
+            __m128i keyed = _mm_xor_si128(data, _mm_xor_si128(secret, _mm_set1_epi64x(i * hash_block_step)));
+            __m128i product = _mm_mul_epu32(keyed, _mm_shuffle_epi32(keyed, _MM_SHUFFLE(0, 3, 0, 1)));
+            __m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+            lanes = _mm_add_epi64(lanes, _mm_add_epi64(product, swapped));
+        }
+        _mm_storeu_si128((__m128i *) acc, lanes);
+    }
+#else
+    for(int i=0; i<blocks; i++)
+    {
+        unsigned long long data[2] = { load64(text + 16 * i), load64(text + 16 * i + 8) };
+        hash_block(acc, data, i);
+    }
+#endif
+    if(blocks<0)
+        blocks = 0;
+    unsigned long long tail[2];
+    hash_tail(text + 16 * blocks, length - 16 * blocks, tail);
+    hash_block(acc, tail, blocks);
+    return hash_finish(acc, length);
+}
+
+/* true if the `length' bytes at `a' and `b' are the same. */
+static bool same_text(const char *a, const char *b, int length)
+{
+    if(length<=16)
+    {
+        if(length>=8)
+            return load64(a)==load64(b) && load64(a + length - 8)==load64(b + length - 8);
+        if(length>=4)
+            return load32(a)==load32(b) && load32(a + length - 4)==load32(b + length - 4);
+        for(int i=0; i<length; i++)
+        {
+            if(a[i]!=b[i])
+                return false;
+        }
+        return true;
+    }
+#ifdef SEMANT_SIMD
+    int i = 0;
+#ifdef __AVX2__
+    for(; i+32<=length; i+=32)
+    {
+        __m256i x = _mm256_loadu_si256((const __m256i *) (a + i));
+        __m256i y = _mm256_loadu_si256((const __m256i *) (b + i));
+        if(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y))!=-1)
+            return false;
+    }
+#endif
+    for(; i+16<=length; i+=16)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *) (a + i));
+        __m128i y = _mm_loadu_si128((const __m128i *) (b + i));
+        if(_mm_movemask_epi8(_mm_cmpeq_epi8(x, y))!=0xffff)
+            return false;
+    }
+    if(i<length)
+    {
+        /* the last block overlaps the one before it rather than reading past the end. */
+        __m128i x = _mm_loadu_si128((const __m128i *) (a + length - 16));
+        __m128i y = _mm_loadu_si128((const __m128i *) (b + length - 16));
+        if(_mm_movemask_epi8(_mm_cmpeq_epi8(x, y))!=0xffff)
+            return false;
+    }
+    return true;
+#else
+    return memcmp(a, b, length)==0;
+#endif
+}
+
+static const unsigned int interner_shard_bits = 6;
+static const unsigned int interner_initial_slots = 64;
+
+struct interned_symbol {
+    unsigned int hash;
+    Symbol sym;
+};
+
+class SymbolInterner {
+    struct shard {
+        pthread_mutex_t lock;
+        std::vector<interned_symbol> slots;
+        unsigned int used;
+    };
+    shard shards[3][1 << interner_shard_bits];
+    pthread_mutex_t tables_lock;
+
+    void grow(shard &s);
+public:
+    SymbolInterner();
+    ~SymbolInterner();
+
+    /* the symbol for `text', which is NUL terminated after `length' characters and hashes to `hash'. */
+    Symbol intern(symbol_table_kind table, char *text, int length, unsigned int hash);
+    size_t size();
+    size_t bytes();
+};
+
+SymbolInterner::SymbolInterner()
+{
+    interned_symbol empty = { 0, NULL };
+    for(int t=0; t<3; t++)
+    {
+        for(unsigned int i=0; i<(1u << interner_shard_bits); i++)
+        {
+            pthread_mutex_init(&shards[t][i].lock, NULL);
+            shards[t][i].slots.assign(interner_initial_slots, empty);
+            shards[t][i].used = 0;
+        }
+    }
+    pthread_mutex_init(&tables_lock, NULL);
+}
+
+SymbolInterner::~SymbolInterner()
+{
+    for(int t=0; t<3; t++)
+    {
+        for(unsigned int i=0; i<(1u << interner_shard_bits); i++)
+            pthread_mutex_destroy(&shards[t][i].lock);
+    }
+    pthread_mutex_destroy(&tables_lock);
+}
+
+void SymbolInterner::grow(shard &s)
+{
+    std::vector<interned_symbol> old;
+    old.swap(s.slots);
+    interned_symbol empty = { 0, NULL };
+    s.slots.assign(old.size() * 2, empty);
+    unsigned int mask = s.slots.size() - 1;
+    for(size_t i=0; i<old.size(); i++)
+    {
+        if(old[i].sym==NULL)
+            continue;
+        unsigned int j = old[i].hash & mask;
+        while(s.slots[j].sym!=NULL)
+            j = (j + 1) & mask;
+        s.slots[j] = old[i];
+    }
+}
+
+Symbol SymbolInterner::intern(symbol_table_kind table, char *text, int length, unsigned int hash)
+{
+    /* the top bits pick the shard and the bottom bits the slot, so the two stay independent. */
+    shard &s = shards[table][hash >> (32 - interner_shard_bits)];
+    pthread_mutex_lock(&s.lock);
+    unsigned int mask = s.slots.size() - 1;
+    unsigned int i = hash & mask;
+    for(; s.slots[i].sym!=NULL; i = (i + 1) & mask)
+    {
+        Symbol sym = s.slots[i].sym;
+        if(s.slots[i].hash==hash && sym->get_len()==length && same_text(sym->get_string(), text, length))
+        {
+            pthread_mutex_unlock(&s.lock);
+            return sym;
+        }
+    }
+
+    pthread_mutex_lock(&tables_lock);
+    Symbol sym;
+    if(table==ID_SYMBOL)
+        sym = idtable.add_string(text, length);
+    else if(table==INT_SYMBOL)
+        sym = inttable.add_string(text, length);
+    else
+        sym = stringtable.add_string(text, length);
+    pthread_mutex_unlock(&tables_lock);
+
+    interned_symbol entry = { hash, sym };
+    s.slots[i] = entry;
+    if(++s.used * 2 > s.slots.size())
+        grow(s);
+    pthread_mutex_unlock(&s.lock);
+    return sym;
+}
+
+size_t SymbolInterner::size()
+{
+    size_t total = 0;
+    for(int t=0; t<3; t++)
+    {
+        for(unsigned int i=0; i<(1u << interner_shard_bits); i++)
+            total += shards[t][i].used;
+    }
+    return total;
+}
+
+size_t SymbolInterner::bytes()
+{
+    size_t total = sizeof(*this);
+    for(int t=0; t<3; t++)
+    {
+        for(unsigned int i=0; i<(1u << interner_shard_bits); i++)
+            total += shards[t][i].slots.capacity() * sizeof(interned_symbol);
+    }
+    return total;
+}
+
+static SymbolInterner symbol_interner;
+
+//////////////////////////////////////////////////////////////////////
+//
+// Mapped AST reader
+//
+// Reads the textual AST written by the parser (the dump_with_types
+// format) straight out of an mmap'ed file.  Tokens are views into the
+// mapping and are never copied; an identifier is only copied once, the
+// first time it is seen, when it is added to its string table.  Token
+// ends are found and hashed 16 bytes at a time, and the hash is used to
+// find the symbol in a reader-local intern cache, so repeated
+// identifiers never reach the shared symbol_interner.
+//
+// read_program() reads a whole file.  read_header() followed by calls
+// to read_class() reads it one class at a time.
+//
+//////////////////////////////////////////////////////////////////////
+
+/* the tag written for each kind of node, indexed by compact_kind. */
+static const char *ast_tags[NUM_COMPACT_KINDS] = {
+    "_program", "_class", "_method", "_attr", "_formal", "_branch",
+    "_assign", "_static_dispatch", "_dispatch", "_cond", "_loop",
+    "_typcase", "_block", "_let", "_plus", "_sub", "_mul",
+    "_divide", "_neg", "_lt", "_eq", "_leq", "_comp",
+    "_int", "_bool", "_string", "_new", "_isvoid", "_no_expr", "_object"
+};
+
+struct ast_token {
+    const char *text;
+    int length;
+    unsigned int hash;
+};
+
+class MappedAstReader {
+public:
+    MappedAstReader();
+    ~MappedAstReader();
+
+    bool open(const char *path);
+    Program read_program();
+    void read_header();
+    Class_ read_class();
+    unsigned int read_compact_program(CompactAst &ast);
+    int program_line_number() { return program_line; }
+
+private:
+    struct cached_symbol {
+        const char *text;
+        int length;
+        unsigned int hash;
+        Symbol sym;
+    };
+
+    const char *path;
+    const char *begin;
+    const char *cursor;
+    const char *end;
+    size_t mapped_length;
+    int program_line;
+    std::vector<cached_symbol> cache[3];
+    unsigned int cache_used[3];
+    std::vector<char> scratch;
+
+    void syntax_error(const char *expected);
+    char peek();
+    ast_token next_token();
+    void expect(char c);
+    int read_line_number();
+    compact_kind read_tag();
+    Symbol intern(const ast_token &token, symbol_table_kind table);
+    Symbol read_symbol(symbol_table_kind table);
+    Symbol read_string();
+    Feature read_feature();
+    Formal read_formal();
+    Case read_case();
+    Expression read_expression();
+    Expressions read_expressions(char terminator);
+    unsigned int read_compact_class(CompactAst &ast);
+    unsigned int read_compact_feature(CompactAst &ast);
+    unsigned int read_compact_formal(CompactAst &ast);
+    unsigned int read_compact_case(CompactAst &ast);
+    unsigned int read_compact_expression(CompactAst &ast);
+    unsigned int read_compact_expressions(CompactAst &ast, char terminator);
+    void read_compact_type(CompactAst &ast, unsigned int node);
+};
+
+MappedAstReader::MappedAstReader()
+    : path(NULL), begin(NULL), cursor(NULL), end(NULL), mapped_length(0), program_line(0)
+{
+    for(int i=0; i<3; i++)
+    {
+        cached_symbol empty = { NULL, 0, 0, NULL };
+        cache[i].assign(1024, empty);
+        cache_used[i] = 0;
+    }
+}
+
+MappedAstReader::~MappedAstReader()
+{
+    if(begin!=NULL && mapped_length>0)
+        munmap((void *) begin, mapped_length);
+}
+
+bool MappedAstReader::open(const char *file)
+{
+    path = file;
+    int fd = ::open(file, O_RDONLY);
+    if(fd==-1)
+        return false;
+    struct stat info;
+    if(fstat(fd, &info)==-1)
+    {
+        close(fd);
+        return false;
+    }
+    mapped_length = info.st_size;
+    if(mapped_length==0)
+    {
+        /* nothing to map; the reader sees an empty input. */
+        static const char empty[] = "";
+        begin = cursor = end = empty;
+        close(fd);
+        return true;
+    }
+    void *data = mmap(NULL, mapped_length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data==MAP_FAILED)
+    {
+        mapped_length = 0;
+        return false;
+    }
+    madvise(data, mapped_length, MADV_SEQUENTIAL);
+    begin = cursor = (const char *) data;
+    end = begin + mapped_length;
+    return true;
+}
+
+void MappedAstReader::syntax_error(const char *expected)
+{
+    cerr << path << ": malformed AST at byte " << (cursor - begin) << ", expected " << expected << endl;
+    exit(1);
+}
+
+/* returns the first character of the next token, or 0 at the end of input. */
+char MappedAstReader::peek()
+{
+    while(cursor<end && (*cursor==' ' || *cursor=='\n' || *cursor=='\t' || *cursor=='\r'))
+        cursor++;
+    return cursor<end ? *cursor : 0;
+}
+
+/* the first space, tab, newline or carriage return in [p, end), or `end'. */
+static const char *find_blank(const char *p, const char *end)
+{
+#ifdef SEMANT_SIMD
+    const __m128i space = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t');
+    const __m128i newline = _mm_set1_epi8('\n'), ret = _mm_set1_epi8('\r');
+    while(end - p >= 16)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i *) p);
+        __m128i blank = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, space), _mm_cmpeq_epi8(chunk, tab)),
+                                     _mm_or_si128(_mm_cmpeq_epi8(chunk, newline), _mm_cmpeq_epi8(chunk, ret)));
+        int mask = _mm_movemask_epi8(blank);
+        if(mask!=0)
+            return p + __builtin_ctz(mask);
+        p += 16;
+    }
+#endif
+    while(p<end && *p!=' ' && *p!='\n' && *p!='\t' && *p!='\r')
+        p++;
+    return p;
+}
+
+/*
+   A token is a run of non-blank characters, except that a string
+   constant runs to its closing quote and may contain blanks.
+ */
+ast_token MappedAstReader::next_token()
+{
+    ast_token token;
+    peek();
+    token.text = cursor;
+    if(cursor<end && *cursor=='"')
+    {
+        cursor++;
+        while(cursor<end && *cursor!='"')
+        {
+            if(*cursor=='\\' && cursor+1<end)
+                cursor++;
+            cursor++;
+        }
+        if(cursor>=end)
+            syntax_error("closing quote");
+        cursor++;
+    }
+    else
+        cursor = find_blank(cursor, end);
+    token.length = cursor - token.text;
+    token.hash = hash_text(token.text, token.length);
+    if(token.length==0)
+        syntax_error("a token");
+    return token;
+}
+
+void MappedAstReader::expect(char c)
+{
+    ast_token token = next_token();
+    if(token.length!=1 || token.text[0]!=c)
+    {
+        char expected[4] = { '\'', c, '\'', '\0' };
+        syntax_error(expected);
+    }
+}
+
+int MappedAstReader::read_line_number()
+{
+    ast_token token = next_token();
+    if(token.text[0]!='#' || token.length<2)
+        syntax_error("a line number");
+    int line = 0;
+    for(int i=1; i<token.length; i++)
+    {
+        if(token.text[i]<'0' || token.text[i]>'9')
+            syntax_error("a line number");
+        line = line * 10 + (token.text[i] - '0');
+    }
+    return line;
+}
+
+compact_kind MappedAstReader::read_tag()
+{
+    ast_token token = next_token();
+    for(int kind=0; kind<NUM_COMPACT_KINDS; kind++)
+    {
+        if((int) strlen(ast_tags[kind])==token.length && memcmp(ast_tags[kind], token.text, token.length)==0)
+            return (compact_kind) kind;
+    }
+    syntax_error("a node tag");
+    return NO_EXPR_NODE;
+}
+
+/*
+   Looks the token up in the cache of its table by hash and bytes.  The
+   cache keys point into the mapping, so only a miss copies the token,
+   unescaping it first if it is a string constant.
+ */
+Symbol MappedAstReader::intern(const ast_token &token, symbol_table_kind table)
+{
+    std::vector<cached_symbol> &slots = cache[table];
+    unsigned int mask = slots.size() - 1;
+    unsigned int i = token.hash & mask;
+    while(slots[i].text!=NULL)
+    {
+        if(slots[i].hash==token.hash && slots[i].length==token.length &&
+           same_text(slots[i].text, token.text, token.length))
+            return slots[i].sym;
+        i = (i + 1) & mask;
+    }
+
+    scratch.clear();
+    if(table==STRING_SYMBOL)
+    {
+        /* drop the quotes and undo print_escaped_string. */
+        const char *p = token.text + 1, *last = token.text + token.length - 1;
+        while(p<last)
+        {
+            if(*p!='\\' || p+1>=last)
+            {
+                scratch.push_back(*p++);
+                continue;
+            }
+            p++;
+            switch(*p)
+            {
+            case 'n': scratch.push_back('\n'); p++; break;
+            case 't': scratch.push_back('\t'); p++; break;
+            case 'b': scratch.push_back('\b'); p++; break;
+            case 'f': scratch.push_back('\f'); p++; break;
+            default:
+                if(*p>='0' && *p<='7' && p+2<last)
+                {
+                    scratch.push_back((char) (((p[0]-'0') << 6) | ((p[1]-'0') << 3) | (p[2]-'0')));
+                    p += 3;
+                }
+                else
+                    scratch.push_back(*p++);
+                break;
+            }
+        }
+    }
+    else
+        scratch.assign(token.text, token.text + token.length);
+    int length = scratch.size();
+    scratch.push_back('\0');
+
+    /* a string constant's token hash covers its quotes and escapes, so hash the text itself. */
+    unsigned int hash = table==STRING_SYMBOL ? hash_text(&scratch[0], length) : token.hash;
+    Symbol sym = symbol_interner.intern(table, &scratch[0], length, hash);
+
+    cached_symbol entry = { token.text, token.length, token.hash, sym };
+    slots[i] = entry;
+    if(++cache_used[table] * 2 > slots.size())
+    {
+        std::vector<cached_symbol> old;
+        old.swap(slots);
+        cached_symbol empty = { NULL, 0, 0, NULL };
+        slots.assign(old.size() * 2, empty);
+        mask = slots.size() - 1;
+        for(unsigned int j=0; j<old.size(); j++)
+        {
+            if(old[j].text==NULL)
+                continue;
+            unsigned int k = old[j].hash & mask;
+            while(slots[k].text!=NULL)
+                k = (k + 1) & mask;
+            slots[k] = old[j];
+        }
+    }
+    return sym;
+}
+
+Symbol MappedAstReader::read_symbol(symbol_table_kind table)
+{
+    return intern(next_token(), table);
+}
+
+Symbol MappedAstReader::read_string()
+{
+    ast_token token = next_token();
+    if(token.text[0]!='"')
+        syntax_error("a string constant");
+    return intern(token, STRING_SYMBOL);
+}
+
+void MappedAstReader::read_header()
+{
+    program_line = read_line_number();
+    if(read_tag()!=PROGRAM_NODE)
+        syntax_error("_program");
+}
+
+/* returns the next class of the program, or NULL at the end of input. */
+Class_ MappedAstReader::read_class()
+{
+    if(peek()==0)
+        return NULL;
+    int line = read_line_number();
+    if(read_tag()!=CLASS_NODE)
+        syntax_error("_class");
+    Symbol name = read_symbol(ID_SYMBOL);
+    Symbol parent = read_symbol(ID_SYMBOL);
+    Symbol filename = read_string();
+    expect('(');
+    Features features = nil_Features();
+    while(peek()=='#')
+        features = append_Features(features, single_Features(read_feature()));
+    expect(')');
+    node_lineno = line;
+    return class_(name, parent, features, filename);
+}
+
+Program MappedAstReader::read_program()
+{
+    read_header();
+    Classes classes = nil_Classes();
+    for(Class_ c = read_class(); c!=NULL; c = read_class())
+        classes = append_Classes(classes, single_Classes(c));
+    node_lineno = program_line;
+    return program(classes);
+}
+
+Feature MappedAstReader::read_feature()
+{
+    int line = read_line_number();
+    compact_kind kind = read_tag();
+    Symbol name = read_symbol(ID_SYMBOL);
+    if(kind==METHOD_NODE)
+    {
+        Formals formals = nil_Formals();
+        while(peek()=='#')
+            formals = append_Formals(formals, single_Formals(read_formal()));
+        Symbol return_type = read_symbol(ID_SYMBOL);
+        Expression body = read_expression();
+        node_lineno = line;
+        return method(name, formals, return_type, body);
+    }
+    if(kind!=ATTR_NODE)
+        syntax_error("_method or _attr");
+    Symbol type_decl = read_symbol(ID_SYMBOL);
+    Expression init = read_expression();
+    node_lineno = line;
+    return attr(name, type_decl, init);
+}
+
+Formal MappedAstReader::read_formal()
+{
+    int line = read_line_number();
+    if(read_tag()!=FORMAL_NODE)
+        syntax_error("_formal");
+    Symbol name = read_symbol(ID_SYMBOL);
+    Symbol type_decl = read_symbol(ID_SYMBOL);
+    node_lineno = line;
+    return formal(name, type_decl);
+}
+
+Case MappedAstReader::read_case()
+{
+    int line = read_line_number();
+    if(read_tag()!=BRANCH_NODE)
+        syntax_error("_branch");
+    Symbol name = read_symbol(ID_SYMBOL);
+    Symbol type_decl = read_symbol(ID_SYMBOL);
+    Expression body = read_expression();
+    node_lineno = line;
+    return branch(name, type_decl, body);
+}
+
+/* reads expressions up to the terminator, which is left unread. */
+Expressions MappedAstReader::read_expressions(char terminator)
+{
+    Expressions list = nil_Expressions();
+    while(peek()!=terminator)
+        list = append_Expressions(list, single_Expressions(read_expression()));
+    return list;
+}
+
+Expression MappedAstReader::read_expression()
+{
+    int line = read_line_number();
+    compact_kind kind = read_tag();
+    Expression e1 = NULL, e2 = NULL, e3 = NULL, e = NULL;
+    Symbol s1 = NULL, s2 = NULL;
+    Expressions list;
+    Cases cases;
+
+    switch(kind)
+    {
+    case ASSIGN_NODE:
+        s1 = read_symbol(ID_SYMBOL);
+        e1 = read_expression();
+        node_lineno = line;
+        e = assign(s1, e1);
+        break;
+    case STATIC_DISPATCH_NODE:
+        e1 = read_expression();
+        s1 = read_symbol(ID_SYMBOL);
+        s2 = read_symbol(ID_SYMBOL);
+        expect('(');
+        list = read_expressions(')');
+        expect(')');
+        node_lineno = line;
+        e = static_dispatch(e1, s1, s2, list);
+        break;
+    case DISPATCH_NODE:
+        e1 = read_expression();
+        s1 = read_symbol(ID_SYMBOL);
+        expect('(');
+        list = read_expressions(')');
+        expect(')');
+        node_lineno = line;
+        e = dispatch(e1, s1, list);
+        break;
+    case COND_NODE:
+        e1 = read_expression();
+        e2 = read_expression();
+        e3 = read_expression();
+        node_lineno = line;
+        e = cond(e1, e2, e3);
+        break;
+    case LOOP_NODE:
+        e1 = read_expression();
+        e2 = read_expression();
+        node_lineno = line;
+        e = loop(e1, e2);
+        break;
+    case TYPCASE_NODE:
+        e1 = read_expression();
+        cases = nil_Cases();
+        while(peek()=='#')
+            cases = append_Cases(cases, single_Cases(read_case()));
+        node_lineno = line;
+        e = typcase(e1, cases);
+        break;
+    case BLOCK_NODE:
+        list = read_expressions(':');
+        node_lineno = line;
+        e = block(list);
+        break;
+    case LET_NODE:
+        s1 = read_symbol(ID_SYMBOL);
+        s2 = read_symbol(ID_SYMBOL);
+        e1 = read_expression();
+        e2 = read_expression();
+        node_lineno = line;
+        e = let(s1, s2, e1, e2);
+        break;
+    case PLUS_NODE:
+    case SUB_NODE:
+    case MUL_NODE:
+    case DIVIDE_NODE:
+    case LT_NODE:
+    case EQ_NODE:
+    case LEQ_NODE:
+        e1 = read_expression();
+        e2 = read_expression();
+        node_lineno = line;
+        switch(kind)
+        {
+        case PLUS_NODE:   e = plus(e1, e2); break;
+        case SUB_NODE:    e = sub(e1, e2); break;
+        case MUL_NODE:    e = mul(e1, e2); break;
+        case DIVIDE_NODE: e = divide(e1, e2); break;
+        case LT_NODE:     e = lt(e1, e2); break;
+        case EQ_NODE:     e = eq(e1, e2); break;
+        default:          e = leq(e1, e2); break;
+        }
+        break;
+    case NEG_NODE:
+    case COMP_NODE:
+    case ISVOID_NODE:
+        e1 = read_expression();
+        node_lineno = line;
+        switch(kind)
+        {
+        case NEG_NODE:  e = neg(e1); break;
+        case COMP_NODE: e = comp(e1); break;
+        default:        e = isvoid(e1); break;
+        }
+        break;
+    case INT_CONST_NODE:
+        s1 = read_symbol(INT_SYMBOL);
+        node_lineno = line;
+        e = int_const(s1);
+        break;
+    case BOOL_CONST_NODE:
+    {
+        ast_token token = next_token();
+        node_lineno = line;
+        e = bool_const(token.length==1 && token.text[0]=='1');
+        break;
+    }
+    case STRING_CONST_NODE:
+        s1 = read_string();
+        node_lineno = line;
+        e = string_const(s1);
+        break;
+    case NEW_NODE:
+        s1 = read_symbol(ID_SYMBOL);
+        node_lineno = line;
+        e = new_(s1);
+        break;
+    case OBJECT_NODE:
+        s1 = read_symbol(ID_SYMBOL);
+        node_lineno = line;
+        e = object(s1);
+        break;
+    case NO_EXPR_NODE:
+        node_lineno = line;
+        e = no_expr();
+        break;
+    default:
+        syntax_error("an expression");
+    }
+
+    expect(':');
+    ast_token type = next_token();
+    if(type.length==8 && memcmp(type.text, "_no_type", 8)==0)
+        e->set_type(NULL);
+    else
+        e->set_type(intern(type, ID_SYMBOL));
+    return e;
+}
+
+/*
+   The read_compact_* functions read the same grammar into a CompactAst
+   instead of building cool-tree nodes.  Building a node reads the
+   global node_lineno, so only this form of reading may run on several
+   threads at once; the tree is materialized afterwards on one thread.
+ */
+unsigned int MappedAstReader::read_compact_program(CompactAst &ast)
+{
+    read_header();
+    unsigned int node = ast.add_node(PROGRAM_NODE, program_line);
+    std::vector<unsigned int> classes;
+    while(peek()!=0)
+        classes.push_back(read_compact_class(ast));
+    ast.set_operands(node, ast.add_list(classes));
+    return node;
+}
+
+unsigned int MappedAstReader::read_compact_class(CompactAst &ast)
+{
+    unsigned int node = ast.add_node(CLASS_NODE, read_line_number());
+    if(read_tag()!=CLASS_NODE)
+        syntax_error("_class");
+    unsigned int name = ast.symbol_id(read_symbol(ID_SYMBOL), ID_SYMBOL);
+    unsigned int parent = ast.symbol_id(read_symbol(ID_SYMBOL), ID_SYMBOL);
+    unsigned int filename = ast.symbol_id(read_string(), STRING_SYMBOL);
+    expect('(');
+    std::vector<unsigned int> features;
+    while(peek()=='#')
+        features.push_back(read_compact_feature(ast));
+    expect(')');
+    ast.set_operands(node, name, parent, ast.add_list(features), filename);
+    return node;
+}
+
+unsigned int MappedAstReader::read_compact_feature(CompactAst &ast)
+{
+    int line = read_line_number();
+    compact_kind kind = read_tag();
+    if(kind!=METHOD_NODE && kind!=ATTR_NODE)
+        syntax_error("_method or _attr");
+    unsigned int node = ast.add_node(kind, line);
+    unsigned int name = ast.symbol_id(read_symbol(ID_SYMBOL), ID_SYMBOL);
+    if(kind==METHOD_NODE)
+    {
+        std::vector<unsigned int> formals;
+        while(peek()=='#')
+            formals.push_back(read_compact_formal(ast));
+        unsigned int return_type = ast.symbol_id(read_symbol(ID_SYMBOL), ID_SYMBOL);
+        unsigned int body = read_compact_expression(ast);
+        ast.set_operands(node, name, ast.add_list(formals), return_type, body);
+        return node;
+    }
+    unsigned int type_decl = ast.symbol_id(read_symbol(ID_SYMBOL), ID_SYMBOL);
+    unsigned int init = read_compact_expression(ast);
+    ast.set_operands(node, name, type_decl, init);
+    return node;
+}
+
+unsigned int MappedAstReader::read_compact_formal(CompactAst &ast)
+{
+    unsigned int node = ast.add_node(FORMAL_NODE, read_line_number());
+    if(read_tag()!=FORMAL_NODE)
+        syntax_error("_formal");
+    unsigned int name = ast.symbol_id(read_symbol(ID_SYMBOL), ID_SYMBOL);
+    unsigned int type_decl = ast.symbol_id(read_symbol(ID_SYMBOL), ID_SYMBOL);
+    ast.set_operands(node, name, type_decl);
+    return node;
+}
+
+unsigned int MappedAstReader::read_compact_case(CompactAst &ast)
+{
+    unsigned int node = ast.add_node(BRANCH_NODE, read_line_number());
+    if(read_tag()!=BRANCH_NODE)
+        syntax_error("_branch");
+    unsigned int name = ast.symbol_id(read_symbol(ID_SYMBOL), ID_SYMBOL);
+    unsigned int type_decl = ast.symbol_id(read_symbol(ID_SYMBOL), ID_SYMBOL);
+    unsigned int body = read_compact_expression(ast);
+    ast.set_operands(node, name, type_decl, body);
+    return node;
+}
+
+/* reads expressions up to the terminator, which is left unread, and returns their list. */
+unsigned int MappedAstReader::read_compact_expressions(CompactAst &ast, char terminator)
+{
+    std::vector<unsigned int> items;
+    while(peek()!=terminator)
+        items.push_back(read_compact_expression(ast));
+    return ast.add_list(items);
+}
+
+void MappedAstReader::read_compact_type(CompactAst &ast, unsigned int node)
+{
+    expect(':');
+    ast_token type = next_token();
+    if(type.length==8 && memcmp(type.text, "_no_type", 8)==0)
+        ast.set_type(node, NULL);
+    else
+        ast.set_type(node, intern(type, ID_SYMBOL));
+}
+
+unsigned int MappedAstReader::read_compact_expression(CompactAst &ast)
+{
+    int line = read_line_number();
+    compact_kind kind = read_tag();
+    if(kind<ASSIGN_NODE)
+        syntax_error("an expression");
+    unsigned int node = ast.add_node(kind, line);
+    unsigned int a = 0, b = 0, c = 0, d = 0;
+
+    switch(kind)
+    {
+    case ASSIGN_NODE:
+        a = ast.symbol_id(read_symbol(ID_SYMBOL), ID_SYMBOL);
+        b = read_compact_expression(ast);
+        break;
+    case STATIC_DISPATCH_NODE:
+        a = read_compact_expression(ast);
+        b = ast.symbol_id(read_symbol(ID_SYMBOL), ID_SYMBOL);
+        c = ast.symbol_id(read_symbol(ID_SYMBOL), ID_SYMBOL);
+        expect('(');
+        d = read_compact_expressions(ast, ')');
+        expect(')');
+        break;
+    case DISPATCH_NODE:
+        a = read_compact_expression(ast);
+        b = ast.symbol_id(read_symbol(ID_SYMBOL), ID_SYMBOL);
+        expect('(');
+        c = read_compact_expressions(ast, ')');
+        expect(')');
+        break;
+    case COND_NODE:
+        a = read_compact_expression(ast);
+        b = read_compact_expression(ast);
+        c = read_compact_expression(ast);
+        break;
+    case TYPCASE_NODE:
+    {
+        a = read_compact_expression(ast);
+        std::vector<unsigned int> cases;
+        while(peek()=='#')
+            cases.push_back(read_compact_case(ast));
+        b = ast.add_list(cases);
+        break;
+    }
+    case BLOCK_NODE:
+        a = read_compact_expressions(ast, ':');
+        break;
+    case LET_NODE:
+        a = ast.symbol_id(read_symbol(ID_SYMBOL), ID_SYMBOL);
+        b = ast.symbol_id(read_symbol(ID_SYMBOL), ID_SYMBOL);
+        c = read_compact_expression(ast);
+        d = read_compact_expression(ast);
+        break;
+    case LOOP_NODE:
+    case PLUS_NODE:
+    case SUB_NODE:
+    case MUL_NODE:
+    case DIVIDE_NODE:
+    case LT_NODE:
+    case EQ_NODE:
+    case LEQ_NODE:
+        a = read_compact_expression(ast);
+        b = read_compact_expression(ast);
+        break;
+    case NEG_NODE:
+    case COMP_NODE:
+    case ISVOID_NODE:
+        a = read_compact_expression(ast);
+        break;
+    case INT_CONST_NODE:
+        a = ast.symbol_id(read_symbol(INT_SYMBOL), INT_SYMBOL);
+        break;
+    case BOOL_CONST_NODE:
+    {
+        ast_token token = next_token();
+        a = token.length==1 && token.text[0]=='1';
+        break;
+    }
+    case STRING_CONST_NODE:
+        a = ast.symbol_id(read_string(), STRING_SYMBOL);
+        break;
+    case NEW_NODE:
+    case OBJECT_NODE:
+        a = ast.symbol_id(read_symbol(ID_SYMBOL), ID_SYMBOL);
+        break;
+    default:
+        break;
+    }
+
+    ast.set_operands(node, a, b, c, d);
+    read_compact_type(ast, node);
+    return node;
+}
+
+/* reads a whole AST file through MappedAstReader; NULL if it cannot be opened. */
+Program read_mapped_ast(const char *path)
+{
+    MappedAstReader reader;
+    if(!reader.open(path))
+    {
+        cerr << "Could not open AST file " << path << endl;
+        return NULL;
+    }
+    return reader.read_program();
+}
+
+/* reads the AST file at `path' into `ast', for semant_compact; false if it cannot be opened. */
+bool read_compact_ast(const char *path, CompactAst &ast, unsigned int &root)
+{
+    MappedAstReader reader;
+    if(!reader.open(path))
+    {
+        cerr << "Could not open AST file " << path << endl;
+        return false;
+    }
+    root = reader.read_compact_program(ast);
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// Multi-file loading
+//
+// read_mapped_asts reads several AST files into one program.  A pool
+// of threads takes files in turn and reads each into a CompactAst of
+// its own, with a reader-local intern cache in front of the shared
+// symbol_interner.  As a thread finishes a file it enters the file's
+// class names in a directory sharded like the interner, which keeps
+// the first definition of every name in input order.  The trees are
+// then materialized on one thread and their classes appended in file
+// order, so the program is the same as for one file holding all of
+// them, and each class keeps the filename its own AST gave it.  A
+// class that redefines one from another file is reported against the
+// file of the first definition.
+//
+//////////////////////////////////////////////////////////////////////
+
+static const unsigned int directory_shard_bits = 6;
+
+struct class_definition {
+    Symbol name;
+    unsigned int file;
+    unsigned int position;
+    Symbol filename;      /* the filename of the class node */
+};
+
+class ClassDirectory {
+    struct shard {
+        pthread_mutex_t lock;
+        std::vector<class_definition> slots;
+        unsigned int used;
+    };
+    shard shards[1 << directory_shard_bits];
+
+    static unsigned int hash(Symbol name);
+    void grow(shard &s);
+public:
+    ClassDirectory();
+    ~ClassDirectory();
+
+    /* notes that class `position' of file `file' defines `name'. */
+    void define(Symbol name, unsigned int file, unsigned int position, Symbol filename);
+    /* the first definition of `name', which must have been defined. */
+    class_definition first(Symbol name);
+};
+
+ClassDirectory::ClassDirectory()
+{
+    class_definition empty = { NULL, 0, 0, NULL };
+    for(unsigned int i=0; i<(1u << directory_shard_bits); i++)
+    {
+        pthread_mutex_init(&shards[i].lock, NULL);
+        shards[i].slots.assign(16, empty);
+        shards[i].used = 0;
+    }
+}
+
+ClassDirectory::~ClassDirectory()
+{
+    for(unsigned int i=0; i<(1u << directory_shard_bits); i++)
+        pthread_mutex_destroy(&shards[i].lock);
+}
+
+/* symbols are interned, so the address identifies the name. */
+unsigned int ClassDirectory::hash(Symbol name)
+{
+    unsigned long long h = (unsigned long long) (size_t) name * 0x9e3779b97f4a7c15ULL;
+    return (unsigned int) (h >> 32);
+}
+
+void ClassDirectory::grow(shard &s)
+{
+    std::vector<class_definition> old;
+    old.swap(s.slots);
+    class_definition empty = { NULL, 0, 0, NULL };
+    s.slots.assign(old.size() * 2, empty);
+    unsigned int mask = s.slots.size() - 1;
+    for(size_t i=0; i<old.size(); i++)
+    {
+        if(old[i].name==NULL)
+            continue;
+        unsigned int j = hash(old[i].name) & mask;
+        while(s.slots[j].name!=NULL)
+            j = (j + 1) & mask;
+        s.slots[j] = old[i];
+    }
+}
+
+void ClassDirectory::define(Symbol name, unsigned int file, unsigned int position, Symbol filename)
+{
+    unsigned int h = hash(name);
+    shard &s = shards[h >> (32 - directory_shard_bits)];
+    pthread_mutex_lock(&s.lock);
+    unsigned int mask = s.slots.size() - 1;
+    unsigned int i = h & mask;
+    while(s.slots[i].name!=NULL && s.slots[i].name!=name)
+        i = (i + 1) & mask;
+    class_definition &slot = s.slots[i];
+    if(slot.name==NULL)
+    {
+        class_definition entry = { name, file, position, filename };
+        slot = entry;
+        if(++s.used * 2 > s.slots.size())
+            grow(s);
+    }
+    else if(file<slot.file || (file==slot.file && position<slot.position))
+    {
+        /* files finish in any order; keep the definition that comes first in the input. */
+        slot.file = file;
+        slot.position = position;
+        slot.filename = filename;
+    }
+    pthread_mutex_unlock(&s.lock);
+}
+
+class_definition ClassDirectory::first(Symbol name)
+{
+    unsigned int h = hash(name);
+    shard &s = shards[h >> (32 - directory_shard_bits)];
+    pthread_mutex_lock(&s.lock);
+    unsigned int mask = s.slots.size() - 1;
+    unsigned int i = h & mask;
+    while(s.slots[i].name!=name)
+        i = (i + 1) & mask;
+    class_definition definition = s.slots[i];
+    pthread_mutex_unlock(&s.lock);
+    return definition;
+}
+
+/* how many files the last read_mapped_asts read, and how many of their classes redefine one from another file. */
+static long ast_files_loaded = 0;
+static long cross_file_redefinitions = 0;
+
+struct ast_file_load {
+    const char *path;
+    CompactAst ast;
+    unsigned int root;
+    bool opened;
+};
+
+struct ast_loader {
+    std::vector<ast_file_load> *files;
+    ClassDirectory *directory;
+    pthread_mutex_t lock;
+    unsigned int next_file;
+};
+
+/* loader thread: reads files until none are left. */
+static void *load_ast_files(void *arg)
+{
+    ast_loader *loader = (ast_loader *) arg;
+    for(;;)
+    {
+        pthread_mutex_lock(&loader->lock);
+        unsigned int file = loader->next_file++;
+        pthread_mutex_unlock(&loader->lock);
+        if(file>=loader->files->size())
+            return NULL;
+
+        ast_file_load &load = (*loader->files)[file];
+        MappedAstReader reader;
+        load.opened = reader.open(load.path);
+        if(!load.opened)
+            continue;
+        CompactAst &ast = load.ast;
+        load.root = reader.read_compact_program(ast);
+        unsigned int classes = ast.operands[load.root].a;
+        for(unsigned int i=0; i<ast.list_length(classes); i++)
+        {
+            compact_operands op = ast.operands[ast.list_item(classes, i)];
+            loader->directory->define(ast.symbol(op.a), file, i, ast.symbol(op.d));
+        }
+    }
+}
+
+/* reads and merges several AST files; NULL if any of them cannot be opened. */
+Program read_mapped_asts(const std::vector<const char *> &paths)
+{
+    std::vector<ast_file_load> files(paths.size());
+    for(size_t i=0; i<paths.size(); i++)
+    {
+        files[i].path = paths[i];
+        files[i].root = 0;
+        files[i].opened = false;
+    }
+
+    ClassDirectory directory;
+    ast_loader loader;
+    loader.files = &files;
+    loader.directory = &directory;
+    pthread_mutex_init(&loader.lock, NULL);
+    loader.next_file = 0;
+
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t thread_count = std::min(files.size(), (size_t) (processors>0 ? processors : 1));
+    std::vector<pthread_t> threads(thread_count);
+    size_t started = 0;
+    for(size_t i=0; i<thread_count; i++)
+    {
+        if(pthread_create(&threads[started], NULL, load_ast_files, &loader)==0)
+            started++;
+    }
+    /* files a thread that failed to start would have taken are loaded here. */
+    if(started<thread_count)
+        load_ast_files(&loader);
+    for(size_t i=0; i<started; i++)
+        pthread_join(threads[i], NULL);
+    pthread_mutex_destroy(&loader.lock);
+
+    ast_files_loaded = files.size();
+    cross_file_redefinitions = 0;
+    earlier_definition_files.clear();
+    for(size_t i=0; i<files.size(); i++)
+    {
+        if(!files[i].opened)
+        {
+            cerr << "Could not open AST file " << files[i].path << endl;
+            return NULL;
+        }
+    }
+
+    Classes classes = nil_Classes();
+    int program_line = files.empty() ? 0 : files[0].ast.lines[files[0].root];
+    for(size_t f=0; f<files.size(); f++)
+    {
+        CompactAst &ast = files[f].ast;
+        ast.materialize(files[f].root);
+        unsigned int list = ast.operands[files[f].root].a;
+        for(unsigned int i=0; i<ast.list_length(list); i++)
+        {
+            Class_ c = (Class_) ast.materialized[ast.list_item(list, i)];
+            class_definition definition = directory.first(c->get_name());
+            if(definition.file!=f)
+            {
+                earlier_definition_files[c] = definition.filename;
+                cross_file_redefinitions++;
+            }
+            classes = append_Classes(classes, single_Classes(c));
+        }
+        /* the compact store is only needed until its classes are built. */
+        ast = CompactAst();
+    }
+    node_lineno = program_line;
+    return program(classes);
 }
 
-////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
 //
-// semant_error is an overloaded function for reporting errors
-// during semantic analysis.  There are three versions:
+// Binary AST format
 //
-//    ostream& ClassTable::semant_error()                
+// A versioned binary encoding of a CompactAst, so the parser, semant
+// and the code generator can hand trees to each other without
+// formatting and re-parsing text.  The file is a fixed header followed
+// by the arrays of the store, each padded to a multiple of four bytes:
 //
-//    ostream& ClassTable::semant_error(Class_ c)
-//       print line number and filename for `c'
+//     binary_ast_header
+//     symbol offsets, lengths (uint32) and string tables (uint8)
+//     symbol text, not NUL terminated
+//     node kinds (uint8), lines (uint32), operands (4 x uint32)
+//     and types (uint32)
+//     list items (uint32)
 //
-//    ostream& ClassTable::semant_error(Symbol filename, tree_node *t)  
-//       print a line number and filename
+// Integers are in host byte order; the header records it so a reader
+// on another machine rejects the file instead of misreading it.
+// Loading is a copy of each array plus one table lookup per distinct
+// symbol.
 //
-///////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
 
-ostream& ClassTable::semant_error(Class_ c)
-{                                                             
-    return semant_error(c->get_filename(),c);
-}    
+static const char binary_ast_magic[8] = { 'C', 'O', 'O', 'L', 'A', 'S', 'T', '\0' };
+static const unsigned int binary_ast_version = 1;
+static const unsigned int binary_ast_byte_order = 0x01020304;
 
-ostream& ClassTable::semant_error(Symbol filename, tree_node *t)
+struct binary_ast_header {
+    char magic[8];
+    unsigned int version;
+    unsigned int byte_order;
+    unsigned int root;
+    unsigned int node_count;
+    unsigned int list_item_count;
+    unsigned int symbol_count;
+    unsigned int text_bytes;
+    unsigned int reserved;
+};
+
+/*
+   What each operand of a node holds: an expression (n), a list of
+   classes (C), features (F), formals (R), branches (B) or expressions
+   (E), a symbol id (s), a constant (c), or nothing (-).  Used to
+   validate files on load.
+ */
+static const char operand_roles[NUM_COMPACT_KINDS][5] = {
+    "C---", "ssFs", "sRsn", "ssn-", "ss--", "ssn-",   /* program .. branch */
+    "sn--", "nssE", "nsE-", "nnn-", "nn--", "nB--",   /* assign .. typcase */
+    "E---", "ssnn", "nn--", "nn--", "nn--", "nn--",   /* block .. divide */
+    "n---", "nn--", "nn--", "nn--", "n---", "s---",   /* neg .. int_const */
+    "c---", "s---", "s---", "n---", "----", "s---"    /* bool_const .. object */
+};
+
+static size_t padded(size_t bytes)
 {
-    error_stream << filename << ":" << t->get_line_number() << ": ";
-    return semant_error();
+    return (bytes + 3) & ~(size_t) 3;
 }
 
-ostream& ClassTable::semant_error()                  
-{                                                 
-    semant_errors++;                            
-    return error_stream;
-} 
+static bool write_section(FILE *file, const void *data, size_t bytes)
+{
+    static const char zeros[4] = { 0, 0, 0, 0 };
+    if(bytes>0 && fwrite(data, 1, bytes, file)!=bytes)
+        return false;
+    size_t padding = padded(bytes) - bytes;
+    return padding==0 || fwrite(zeros, 1, padding, file)==padding;
+}
 
-bool subClass(Symbol first, Symbol parent)
+bool write_binary_ast(CompactAst &ast, unsigned int root, const char *path)
 {
-    while(first!=No_class)
+    unsigned int symbol_count = ast.symbols.size();
+    std::vector<unsigned int> offsets(symbol_count), lengths(symbol_count);
+    std::vector<char> text;
+    for(unsigned int i=1; i<symbol_count; i++)
     {
-        first = inheritance_graph.find(first)->second->get_parent();
-        if(first == parent)
-            return true;
+        Symbol sym = ast.symbols[i];
+        offsets[i] = text.size();
+        lengths[i] = sym->get_len();
+        text.insert(text.end(), sym->get_string(), sym->get_string() + sym->get_len());
     }
-    return false;
+
+    binary_ast_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, binary_ast_magic, sizeof(header.magic));
+    header.version = binary_ast_version;
+    header.byte_order = binary_ast_byte_order;
+    header.root = root;
+    header.node_count = ast.kinds.size();
+    header.list_item_count = ast.list_items.size();
+    header.symbol_count = symbol_count;
+    header.text_bytes = text.size();
+
+    FILE *file = fopen(path, "wb");
+    if(file==NULL)
+        return false;
+    unsigned int nodes = header.node_count;
+    bool ok = write_section(file, &header, sizeof(header)) &&
+        write_section(file, &offsets[0], symbol_count * sizeof(unsigned int)) &&
+        write_section(file, &lengths[0], symbol_count * sizeof(unsigned int)) &&
+        write_section(file, &ast.symbol_tables[0], symbol_count) &&
+        write_section(file, text.empty() ? NULL : &text[0], text.size()) &&
+        write_section(file, nodes ? &ast.kinds[0] : NULL, nodes) &&
+        write_section(file, nodes ? &ast.lines[0] : NULL, nodes * sizeof(unsigned int)) &&
+        write_section(file, nodes ? &ast.operands[0] : NULL, nodes * sizeof(compact_operands)) &&
+        write_section(file, nodes ? &ast.types[0] : NULL, nodes * sizeof(unsigned int)) &&
+        write_section(file, ast.list_items.empty() ? NULL : &ast.list_items[0],
+                      ast.list_items.size() * sizeof(unsigned int));
+    return fclose(file)==0 && ok;
 }
 
-Feature getmethods(Class_ cur_class , Symbol method_name)
+/* compacts the program and writes it in the binary format. */
+bool write_binary_ast(Program program, const char *path)
 {
-    Feature feature = NULL;
-    Symbol feature_name;
-    Features features = cur_class->get_features();
-    for(int i=features->first();features->more(i);i=features->next(i))
+    CompactAst ast;
+    unsigned int root = program->compact(ast);
+    return write_binary_ast(ast, root, path);
+}
+
+/* copies count elements of a section out of the file, advancing past it. */
+template <class T>
+static bool read_section(const char *&cursor, const char *end, std::vector<T> &out, size_t count)
+{
+    size_t bytes = count * sizeof(T);
+    if((size_t) (end - cursor) < padded(bytes))
+        return false;
+    out.resize(count);
+    if(bytes>0)
+        memcpy(&out[0], cursor, bytes);
+    cursor += padded(bytes);
+    return true;
+}
+
+/*
+   Children always come after their parent in preorder, which also
+   rules out cycles.
+ */
+static bool valid_child(CompactAst &ast, unsigned int node, unsigned int child, char role)
+{
+    if(child<=node || child>=ast.kinds.size())
+        return false;
+    unsigned char kind = ast.kinds[child];
+    switch(role)
     {
-        feature = features->nth(i);
-        feature_name = feature->get_name();
-        if(feature_name==method_name)
-            return feature;
+    case 'C': return kind==CLASS_NODE;
+    case 'F': return kind==METHOD_NODE || kind==ATTR_NODE;
+    case 'R': return kind==FORMAL_NODE;
+    case 'B': return kind==BRANCH_NODE;
+    default:  return kind>=ASSIGN_NODE;
     }
-    Symbol parent = cur_class->get_parent();
-    if(inheritance_graph.find(parent)==inheritance_graph.end())
-        return NULL;
-    cur_class = inheritance_graph.find(parent)->second;
-    return getmethods(cur_class,method_name);
 }
 
-Symbol assign_class::get_expression_type(Class_ cur_class)
+static bool valid_operand(CompactAst &ast, unsigned int node, char role, unsigned int operand)
 {
-    Symbol *left_type = attribute_table->lookup(name);
-    if(left_type==NULL)
+    switch(role)
     {
-        classtable->semant_error(cur_class)<<"Assignment to undeclared variable "<<name<<".\n";
-        type = Object;
-        return Object;
+    case 'n':
+        return valid_child(ast, node, operand, role);
+    case 's':
+        return operand > 0 && operand < ast.symbols.size();
+    case 'c':
+    case '-':
+        return true;
+    default:
+        if(operand>=ast.list_items.size() || ast.list_items[operand] > ast.list_items.size() - operand - 1)
+            return false;
+        for(unsigned int i=0; i<ast.list_length(operand); i++)
+        {
+            if(!valid_child(ast, node, ast.list_item(operand, i), role))
+                return false;
+        }
+        return true;
     }
+}
 
-    Symbol right_type = expr->get_expression_type(cur_class);
-    if(*left_type!=right_type && (!subClass(right_type,*left_type)))
+static bool valid_binary_ast(CompactAst &ast, unsigned int root)
+{
+    for(unsigned int node=0; node<ast.kinds.size(); node++)
     {
-        classtable->semant_error(cur_class)<<"Type "<<right_type<<" of assigned expression does not conform to declared type "<<*left_type<<" of identifier "<<name<<".\n";
-        type = Object;
-        return Object;
+        if(ast.kinds[node]>=NUM_COMPACT_KINDS || ast.types[node]>=ast.symbols.size())
+            return false;
     }
-
-    type = *left_type;
-    return *left_type;
+    if(root>=ast.kinds.size() || ast.kinds[root]!=PROGRAM_NODE)
+        return false;
+    for(unsigned int node=0; node<ast.kinds.size(); node++)
+    {
+        const char *roles = operand_roles[ast.kinds[node]];
+        compact_operands &op = ast.operands[node];
+        if(!valid_operand(ast, node, roles[0], op.a) || !valid_operand(ast, node, roles[1], op.b) ||
+           !valid_operand(ast, node, roles[2], op.c) || !valid_operand(ast, node, roles[3], op.d))
+            return false;
+    }
+    return true;
 }
 
-Symbol static_dispatch_class::get_expression_type(Class_ cur_class)
+/*
+   Loads a binary AST file into `ast'.  On failure an error is printed
+   and false returned.
+ */
+bool read_binary_ast(const char *path, CompactAst &ast, unsigned int &root)
 {
-    Symbol first_expr_type = expr->get_expression_type(cur_class);
-    if(inheritance_graph.find(type_name)==inheritance_graph.end())
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+    if(fd==-1 || fstat(fd, &info)==-1)
     {
-        classtable->semant_error(cur_class)<<"Class "<<type_name<<" is undefined\n";
-        type = Object;
-        return type;
+        if(fd!=-1)
+            close(fd);
+        cerr << "Could not open AST file " << path << endl;
+        return false;
     }
-    if(first_expr_type==SELF_TYPE)
-        first_expr_type=cur_class->get_name();
-    if(first_expr_type!=type_name &&(!subClass(first_expr_type,type_name)))
+    size_t length = info.st_size;
+    void *data = length ? mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if(data==MAP_FAILED)
     {
-        classtable->semant_error(cur_class)<<"Expression type "<<first_expr_type<<" is not of inherited from class"<<type_name<<endl;
-        type = Object;
-        return type;
+        cerr << path << ": not a binary AST file" << endl;
+        return false;
     }
 
-    Feature feature = getmethods(inheritance_graph.find(type_name)->second,name);
-    if(feature==NULL)
+    const char *cursor = (const char *) data, *end = cursor + length;
+    binary_ast_header header;
+    bool ok = length >= sizeof(header);
+    if(ok)
     {
-        classtable->semant_error(cur_class)<<"Method "<<name<<" is undefined\n";
-        type = Object;
-        return type;
+        memcpy(&header, cursor, sizeof(header));
+        cursor += sizeof(header);
+        ok = memcmp(header.magic, binary_ast_magic, sizeof(header.magic))==0 &&
+            header.byte_order==binary_ast_byte_order;
     }
-
-    Formals def_formals = feature->get_formals();
-    int num_actuals = actual->len();
-    int num_formals = def_formals->len();
-    if(num_actuals!=num_formals)
+    if(ok && header.version!=binary_ast_version)
     {
-        classtable->semant_error(cur_class)<<"Lenght of Actuals is not equal to the formals\n";
-        type = Object;
-        return type;
+        cerr << path << ": binary AST version " << header.version << " is not supported (expected "
+             << binary_ast_version << ")" << endl;
+        munmap(data, length);
+        return false;
     }
-    for(int i=actual->first();actual->more(i);i=actual->next(i))
+
+    std::vector<unsigned int> offsets, lengths;
+    std::vector<char> text;
+    ok = ok && header.symbol_count > 0 &&
+        read_section(cursor, end, offsets, header.symbol_count) &&
+        read_section(cursor, end, lengths, header.symbol_count) &&
+        read_section(cursor, end, ast.symbol_tables, header.symbol_count) &&
+        read_section(cursor, end, text, header.text_bytes) &&
+        read_section(cursor, end, ast.kinds, header.node_count) &&
+        read_section(cursor, end, ast.lines, header.node_count) &&
+        read_section(cursor, end, ast.operands, header.node_count) &&
+        read_section(cursor, end, ast.types, header.node_count) &&
+        read_section(cursor, end, ast.list_items, header.list_item_count);
+    munmap(data, length);
+
+    /* intern the symbols, NUL terminating each for the string tables. */
+    ast.symbols.assign(ok ? header.symbol_count : 0, NULL);
+    ast.symbol_ids.clear();
+    std::vector<char> name;
+    for(unsigned int i=1; ok && i<header.symbol_count; i++)
     {
-        Symbol actual_type = actual->nth(i)->get_expression_type(cur_class);
-        Symbol formal_type = def_formals->nth(i)->get_type();
-        if(actual_type!=formal_type&& (!subClass(actual_type,formal_type)))
+        if(offsets[i] > text.size() || lengths[i] > text.size() - offsets[i] || ast.symbol_tables[i] > STRING_SYMBOL)
         {
-            classtable->semant_error(cur_class)<<"Actuals does not conforms with the Formals\n";
-            type = Object;
-            return type;
+            ok = false;
+            break;
         }
+        name.assign(text.begin() + offsets[i], text.begin() + offsets[i] + lengths[i]);
+        name.push_back('\0');
+        Symbol sym = symbol_interner.intern((symbol_table_kind) ast.symbol_tables[i], &name[0], lengths[i],
+                                            hash_text(&name[0], lengths[i]));
+        ast.symbols[i] = sym;
+        ast.symbol_ids.insert(std::pair<Symbol, unsigned int>(sym, i));
     }
 
-    type = feature->get_return_type();
-    if(type==SELF_TYPE)
-        type = first_expr_type;
-    return type;
+    if(!ok || !valid_binary_ast(ast, header.root))
+    {
+        cerr << path << ": not a valid binary AST file" << endl;
+        return false;
+    }
+    root = header.root;
+    return true;
 }
 
-Symbol dispatch_class::get_expression_type(Class_ cur_class)
+/*
+   Reads a binary AST file and rebuilds its tree; NULL on failure.  To
+   check the program without building the tree, pass the store from
+   read_binary_ast to semant_compact instead.
+ */
+Program read_binary_program(const char *path)
 {
-    Symbol first_expr_type = expr->get_expression_type(cur_class);
-    if(inheritance_graph.find(first_expr_type)==inheritance_graph.end())
+    CompactAst ast;
+    unsigned int root;
+    if(!read_binary_ast(path, ast, root))
+        return NULL;
+    return ast.materialize(root);
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// Typed AST writer
+//
+// Writes a decorated tree in the same text format as dump_with_types,
+// without going through ostream for every field.  The tree is first
+// copied into a CompactAst, which also captures the types set by
+// get_expression_type; the writer then formats it into a ring of large
+// preallocated chunks with hand-written integer, padding and escaping
+// routines.  Full chunks are written together, with writev when the
+// destination is a file descriptor.
+//
+//////////////////////////////////////////////////////////////////////
+
+class TypedAstWriter {
+public:
+    TypedAstWriter(int fd);
+    TypedAstWriter(ostream &stream);
+
+    void emit(CompactAst &ast, unsigned int root);
+    bool flush();
+
+private:
+    enum { chunk_bytes = 1 << 19, num_chunks = 8 };
+
+    int fd;
+    ostream *stream;
+    bool failed;
+    std::vector<char> chunks[num_chunks];
+    size_t used[num_chunks];
+    int current;
+    CompactAst *ast;
+
+    void init();
+    char *reserve(size_t bytes);
+    void release(char *end);
+    char *pad(char *p, int n);
+    void line_marker(int n, unsigned int node);
+    void tag_line(int n, unsigned int node);
+    void text_line(int n, const char *text, int length);
+    void symbol_line(int n, unsigned int id);
+    void quoted_line(int n, unsigned int id);
+    void type_line(int n, unsigned int node);
+    void emit_list(int n, unsigned int list);
+    void emit_node(int n, unsigned int node);
+};
+
+TypedAstWriter::TypedAstWriter(int f) : fd(f), stream(NULL)
+{
+    init();
+}
+
+TypedAstWriter::TypedAstWriter(ostream &s) : fd(-1), stream(&s)
+{
+    init();
+}
+
+void TypedAstWriter::init()
+{
+    failed = false;
+    current = 0;
+    ast = NULL;
+    for(int i=0; i<num_chunks; i++)
     {
-        classtable->semant_error(cur_class)<<"Class "<<first_expr_type<<" is undefined.\n";
-        type = Object;
-        return type;
+        chunks[i].resize(chunk_bytes);
+        used[i] = 0;
     }
-    Feature feature;
-    if(first_expr_type==SELF_TYPE)
-        feature = getmethods(cur_class,name);
-    else 
-        feature = getmethods(inheritance_graph.find(first_expr_type)->second,name);
-    if(feature==NULL)
+}
+
+/* writes out every chunk filled so far and starts over at the first. */
+bool TypedAstWriter::flush()
+{
+    if(fd!=-1)
     {
-        classtable->semant_error(cur_class)<<"Method "<<name<<" is undefined.\n";
-        type = Object;
-        return type;   
+        struct iovec iov[num_chunks];
+        int count = 0;
+        for(int i=0; i<=current; i++)
+        {
+            if(used[i]==0)
+                continue;
+            iov[count].iov_base = &chunks[i][0];
+            iov[count].iov_len = used[i];
+            count++;
+        }
+        struct iovec *next = iov;
+        while(count>0 && !failed)
+        {
+            ssize_t written = writev(fd, next, count);
+            if(written<0 && errno==EINTR)
+                continue;
+            if(written<0)
+            {
+                failed = true;
+                break;
+            }
+            /* skip what a short write got out and retry the rest. */
+            while(count>0 && (size_t) written>=next->iov_len)
+            {
+                written -= next->iov_len;
+                next++;
+                count--;
+            }
+            if(count>0)
+            {
+                next->iov_base = (char *) next->iov_base + written;
+                next->iov_len -= written;
+            }
+        }
     }
-    Formals def_formals = feature->get_formals();
-    int num_actuals = actual->len();
-    int num_formals = def_formals->len();
-    if(num_actuals!=num_formals)
+    else
     {
-        classtable->semant_error(cur_class)<<"Lenght of Actuals is not equal to the formals\n";
-        type = Object;
-        return type;
+        for(int i=0; i<=current; i++)
+            stream->write(&chunks[i][0], used[i]);
+        failed = failed || stream->fail();
     }
-    for(int i=actual->first();actual->more(i);i=actual->next(i))
+    for(int i=0; i<=current; i++)
+        used[i] = 0;
+    current = 0;
+    return !failed;
+}
+
+/* returns room for `bytes' more characters, moving on to the next chunk if needed. */
+char *TypedAstWriter::reserve(size_t bytes)
+{
+    if(used[current] + bytes > chunks[current].size())
     {
-        Symbol actual_type = actual->nth(i)->get_expression_type(cur_class);
-        Symbol formal_type = def_formals->nth(i)->get_type();
-        if(actual_type==SELF_TYPE)
-            actual_type=cur_class->get_name();
-        if(actual_type!=formal_type&& (!subClass(actual_type,formal_type)))
-        {
-            classtable->semant_error(cur_class)<<"Actuals does not conforms with the Formals\n";
-            type = Object;
-            return type;
-        }
+        if(current+1==num_chunks)
+            flush();
+        else
+            current++;
+        if(chunks[current].size() < bytes)
+            chunks[current].resize(bytes);
     }
-    type = feature->get_return_type();
-    if(type ==SELF_TYPE)
-        type = first_expr_type;
-    return type;
+    return &chunks[current][0] + used[current];
 }
 
-Symbol cond_class::get_expression_type(Class_ cur_class)
+void TypedAstWriter::release(char *end)
 {
-    return No_type;
+    used[current] = end - &chunks[current][0];
 }
 
-Symbol loop_class::get_expression_type(Class_ cur_class)
+char *TypedAstWriter::pad(char *p, int n)
+{
+    memset(p, ' ', n);
+    return p + n;
+}
+
+void TypedAstWriter::line_marker(int n, unsigned int node)
 {
-    if(pred->get_expression_type(cur_class)!=Bool)
+    char *p = pad(reserve(n + 13), n);
+    *p++ = '#';
+    char digits[10];
+    int count = 0;
+    unsigned int line = ast->lines[node];
+    do
     {
-        classtable->semant_error(cur_class)<<"Loop condition does not have type Bool.\n";
-    }
-    body->get_expression_type(cur_class);
-    type = Object;
-    return Object;
+        digits[count++] = '0' + line % 10;
+        line /= 10;
+    } while(line>0);
+    while(count>0)
+        *p++ = digits[--count];
+    *p++ = '\n';
+    release(p);
 }
 
-Symbol typcase_class::get_expression_type(Class_ cur_class)
+void TypedAstWriter::text_line(int n, const char *text, int length)
 {
-    return No_type;
+    char *p = pad(reserve(n + length + 1), n);
+    memcpy(p, text, length);
+    p += length;
+    *p++ = '\n';
+    release(p);
 }
 
-Symbol block_class::get_expression_type(Class_ cur_class)
+void TypedAstWriter::tag_line(int n, unsigned int node)
 {
-    Symbol expr_type;
-    for(int i=body->first();body->more(i);i=body->next(i))
-    {
-        expr_type=body->nth(i)->get_expression_type(cur_class);
-    }
-    type = expr_type;
-    return expr_type;
+    const char *tag = ast_tags[ast->kinds[node]];
+    text_line(n, tag, strlen(tag));
 }
 
-Symbol let_class::get_expression_type(Class_ cur_class)
+void TypedAstWriter::symbol_line(int n, unsigned int id)
 {
-    return No_type;
+    Symbol sym = ast->symbol(id);
+    text_line(n, sym->get_string(), sym->get_len());
 }
 
-Symbol plus_class::get_expression_type(Class_ cur_class)
+/* a string constant, quoted and escaped as print_escaped_string does. */
+void TypedAstWriter::quoted_line(int n, unsigned int id)
 {
-    if(e1->get_expression_type(cur_class)!=Int || e2->get_expression_type(cur_class)!=Int)
+    Symbol sym = ast->symbol(id);
+    const char *s = sym->get_string();
+    int length = sym->get_len();
+    char *p = pad(reserve(n + 4 * length + 3), n);
+    *p++ = '"';
+    for(int i=0; i<length; i++)
     {
-        classtable->semant_error(cur_class)<<"non-Int arguments: "<<e1->get_expression_type(cur_class)<<" + "<<e2->get_expression_type(cur_class)<<".\n";
-        type = Object;
-        return Object;
+        unsigned char c = s[i];
+        switch(c)
+        {
+        case '\\': *p++ = '\\'; *p++ = '\\'; break;
+        case '"':  *p++ = '\\'; *p++ = '"'; break;
+        case '\n': *p++ = '\\'; *p++ = 'n'; break;
+        case '\t': *p++ = '\\'; *p++ = 't'; break;
+        case '\b': *p++ = '\\'; *p++ = 'b'; break;
+        case '\f': *p++ = '\\'; *p++ = 'f'; break;
+        default:
+            if(isprint(c))
+                *p++ = c;
+            else
+            {
+                *p++ = '\\';
+                *p++ = '0' + ((c >> 6) & 7);
+                *p++ = '0' + ((c >> 3) & 7);
+                *p++ = '0' + (c & 7);
+            }
+            break;
+        }
     }
-    type = Int;
-    return Int;
+    *p++ = '"';
+    *p++ = '\n';
+    release(p);
 }
 
-Symbol sub_class::get_expression_type(Class_ cur_class)
+void TypedAstWriter::type_line(int n, unsigned int node)
 {
-    if(e1->get_expression_type(cur_class)!=Int || e2->get_expression_type(cur_class)!=Int)
-    {
-        classtable->semant_error(cur_class)<<"non-Int arguments: "<<e1->get_expression_type(cur_class)<<" - "<<e2->get_expression_type(cur_class)<<".\n";
-        type = Object;
-        return Object;
-    }
-    type = Int;
-    return Int;
+    Symbol type = ast->symbol(ast->types[node]);
+    const char *text = type ? type->get_string() : "_no_type";
+    int length = type ? type->get_len() : 8;
+    char *p = pad(reserve(n + length + 3), n);
+    *p++ = ':';
+    *p++ = ' ';
+    memcpy(p, text, length);
+    p += length;
+    *p++ = '\n';
+    release(p);
 }
 
-Symbol mul_class::get_expression_type(Class_ cur_class)
+void TypedAstWriter::emit_list(int n, unsigned int list)
 {
-    if(e1->get_expression_type(cur_class)!=Int || e2->get_expression_type(cur_class)!=Int)
-    {
-        classtable->semant_error(cur_class)<<"non-Int arguments: "<<e1->get_expression_type(cur_class)<<" * "<<e2->get_expression_type(cur_class)<<".\n";
-        type = Object;
-        return Object;
-    }
-    type = Int;
-    return Int;
+    for(unsigned int i=0; i<ast->list_length(list); i++)
+        emit_node(n, ast->list_item(list, i));
 }
 
-Symbol divide_class::get_expression_type(Class_ cur_class)
+void TypedAstWriter::emit_node(int n, unsigned int node)
 {
-    if(e1->get_expression_type(cur_class)!=Int || e2->get_expression_type(cur_class)!=Int)
+    compact_operands op = ast->operands[node];
+    unsigned char kind = ast->kinds[node];
+    line_marker(n, node);
+    tag_line(n, node);
+
+    switch(kind)
     {
-        classtable->semant_error(cur_class)<<"non-Int arguments: "<<e1->get_expression_type(cur_class)<<" / "<<e2->get_expression_type(cur_class)<<".\n";
-        type = Object;
-        return Object;
+    case PROGRAM_NODE:
+        emit_list(n+2, op.a);
+        return;
+    case CLASS_NODE:
+        symbol_line(n+2, op.a);
+        symbol_line(n+2, op.b);
+        quoted_line(n+2, op.d);
+        text_line(n+2, "(", 1);
+        emit_list(n+2, op.c);
+        text_line(n+2, ")", 1);
+        return;
+    case METHOD_NODE:
+        symbol_line(n+2, op.a);
+        emit_list(n+2, op.b);
+        symbol_line(n+2, op.c);
+        emit_node(n+2, op.d);
+        return;
+    case ATTR_NODE:
+    case BRANCH_NODE:
+        symbol_line(n+2, op.a);
+        symbol_line(n+2, op.b);
+        emit_node(n+2, op.c);
+        return;
+    case FORMAL_NODE:
+        symbol_line(n+2, op.a);
+        symbol_line(n+2, op.b);
+        return;
+    case ASSIGN_NODE:
+        symbol_line(n+2, op.a);
+        emit_node(n+2, op.b);
+        break;
+    case STATIC_DISPATCH_NODE:
+        emit_node(n+2, op.a);
+        symbol_line(n+2, op.b);
+        symbol_line(n+2, op.c);
+        text_line(n+2, "(", 1);
+        emit_list(n+2, op.d);
+        text_line(n+2, ")", 1);
+        break;
+    case DISPATCH_NODE:
+        emit_node(n+2, op.a);
+        symbol_line(n+2, op.b);
+        text_line(n+2, "(", 1);
+        emit_list(n+2, op.c);
+        text_line(n+2, ")", 1);
+        break;
+    case COND_NODE:
+        emit_node(n+2, op.a);
+        emit_node(n+2, op.b);
+        emit_node(n+2, op.c);
+        break;
+    case TYPCASE_NODE:
+        emit_node(n+2, op.a);
+        emit_list(n+2, op.b);
+        break;
+    case BLOCK_NODE:
+        emit_list(n+2, op.a);
+        break;
+    case LET_NODE:
+        symbol_line(n+2, op.a);
+        symbol_line(n+2, op.b);
+        emit_node(n+2, op.c);
+        emit_node(n+2, op.d);
+        break;
+    case LOOP_NODE:
+    case PLUS_NODE:
+    case SUB_NODE:
+    case MUL_NODE:
+    case DIVIDE_NODE:
+    case LT_NODE:
+    case EQ_NODE:
+    case LEQ_NODE:
+        emit_node(n+2, op.a);
+        emit_node(n+2, op.b);
+        break;
+    case NEG_NODE:
+    case COMP_NODE:
+    case ISVOID_NODE:
+        emit_node(n+2, op.a);
+        break;
+    case BOOL_CONST_NODE:
+        text_line(n+2, op.a ? "1" : "0", 1);
+        break;
+    case STRING_CONST_NODE:
+        quoted_line(n+2, op.a);
+        break;
+    case INT_CONST_NODE:
+    case NEW_NODE:
+    case OBJECT_NODE:
+        symbol_line(n+2, op.a);
+        break;
+    default:
+        break;
     }
-    type = Int;
-    return Int;
+    type_line(n, node);
 }
 
-Symbol neg_class::get_expression_type(Class_ cur_class)
+void TypedAstWriter::emit(CompactAst &tree, unsigned int root)
 {
-    Symbol expr_type = e1->get_expression_type(cur_class);
-    if(expr_type!=Int)
-    {
-        classtable->semant_error(cur_class)<<"Argument of '~' has type "<<expr_type<<" instead of Int.\n";
-        type = Object;
-        return Object;
-    }
-    type = Int;
-    return Int;
+    ast = &tree;
+    emit_node(0, root);
 }
 
-Symbol lt_class::get_expression_type(Class_ cur_class)
+/*
+   Writes the decorated program to `fd' in the dump_with_types format.
+   Returns false if a write failed.
+ */
+bool dump_typed_ast(Program program, int fd)
 {
-    Symbol left = e1->get_expression_type(cur_class);
-    Symbol right = e2->get_expression_type(cur_class);
-    if(left!=Int || right!=Int)
-    {
-        classtable->semant_error(cur_class)<<"non-Int arguments: "<<left<<" < "<<right<<"\n";
-        type = Object;
-        return Object;
-    }
-    type = Bool;
-    return Bool;
+    CompactAst ast;
+    unsigned int root = program->compact(ast);
+    TypedAstWriter writer(fd);
+    writer.emit(ast, root);
+    return writer.flush();
 }
 
-Symbol eq_class::get_expression_type(Class_ cur_class)
+bool dump_typed_ast(Program program, ostream &stream)
 {
-    Symbol left = e1->get_expression_type(cur_class);
-    Symbol right = e2->get_expression_type(cur_class);
-    if(((left==Int|| right==Int) || (left==Bool|| right==Bool) || (left==Str|| right==Str))&& (left!=right))
-    {
-        classtable->semant_error(cur_class)<<"Invalid comparison between two classes\n";
-        type = Object;
-        return Object;
-    }
-    type = Bool;
-    return Bool;
+    CompactAst ast;
+    unsigned int root = program->compact(ast);
+    TypedAstWriter writer(stream);
+    writer.emit(ast, root);
+    return writer.flush();
+}
 
+/* the same for a program that semant_compact checked in the store. */
+bool dump_typed_ast(CompactAst &ast, unsigned int root, ostream &stream)
+{
+    TypedAstWriter writer(stream);
+    writer.emit(ast, root);
+    return writer.flush();
 }
 
-Symbol leq_class::get_expression_type(Class_ cur_class)
+struct ast_memory {
+    long nodes;
+    long bytes;
+};
+
+static void count_ast_node(tree_node *, size_t bytes, void *data)
 {
-    Symbol left = e1->get_expression_type(cur_class);
-    Symbol right = e2->get_expression_type(cur_class);
-    if(left!=Int || right!=Int)
+    ast_memory *memory = (ast_memory *) data;
+    memory->nodes++;
+    memory->bytes += bytes;
+}
+
+/*
+   The scopes check_class builds.  They are emptied after every class;
+   with SEMANT_MAX_MEMORY=n (bytes, or with a k, m or g suffix) the
+   table and the dispatch cache also give their memory back whenever
+   what they retain passes n, so a long run keeps a fixed footprint at
+   the price of regrowing them.
+ */
+static ScopedTable<Symbol, Symbol> class_attributes(&attribute_scope_memory);
+static long memory_releases = 0;
+
+/* SEMANT_MAX_MEMORY in bytes; 0, after a warning, if it is not a number with an optional suffix. */
+static size_t parse_memory_limit()
+{
+    char *value = getenv("SEMANT_MAX_MEMORY");
+    if(value==NULL || *value=='\0')
+        return 0;
+    char *suffix;
+    errno = 0;
+    unsigned long long limit = strtoull(value, &suffix, 10);
+    int shift = 0;
+    switch(tolower((unsigned char) *suffix))
     {
-        classtable->semant_error(cur_class)<<"non-Int arguments: "<<left<<" <= "<<right<<"\n";
-        type = Object;
-        return Object;
+    case 'g': shift = 30; suffix++; break;
+    case 'm': shift = 20; suffix++; break;
+    case 'k': shift = 10; suffix++; break;
     }
-    type = Bool;
-    return Bool;
+    if(!isdigit((unsigned char) value[0]) || *suffix!='\0' || errno==ERANGE ||
+       limit > (unsigned long long) ((size_t) -1 >> shift))
+    {
+        cerr << "Ignoring SEMANT_MAX_MEMORY=" << value << ": not a number of bytes with an optional k, m or g suffix." << endl;
+        return 0;
+    }
+    return (size_t) limit << shift;
 }
 
-Symbol comp_class::get_expression_type(Class_ cur_class)
+static size_t memory_limit()
 {
-    Symbol expr_type=e1->get_expression_type(cur_class);
-    if(expr_type!=Bool)
+    static size_t limit = parse_memory_limit();
+    return limit;
+}
+
+static void enforce_memory_limit()
+{
+    size_t limit = memory_limit();
+    if(limit==0 || class_attributes.bytes() + dispatch_cache.bytes() <= limit)
+        return;
+    class_attributes.release();
+    dispatch_cache.clear();
+    memory_releases++;
+}
+
+static bool semant_report_requested()
+{
+    return semant_debug || semant_option("SEMANT_STATS") || semant_option("SEMANT_PERF");
+}
+
+static void print_semant_report(Program program)
+{
+    if(!semant_report_requested())
+        return;
+
+    fprintf(stderr, "semant statistics\n");
+    if(perf_counters_open())
+    {
+        fprintf(stderr, "  %-32s %12s %14s %14s %6s %12s %12s\n",
+                "phase", "wall ms", "cycles", "instructions", "IPC", "LLC misses", "br misses");
+        for(int i=0; i<NUM_PHASES; i++)
+        {
+            long long *counts = phase_counts[i];
+            double ipc = counts[CYCLES_COUNTER] ? (double) counts[INSTRUCTIONS_COUNTER] / counts[CYCLES_COUNTER] : 0.0;
+            fprintf(stderr, "  %-32s %12.3f %14lld %14lld %6.2f %12lld %12lld\n",
+                    phase_names[i], phase_seconds[i] * 1000.0,
+                    counts[CYCLES_COUNTER], counts[INSTRUCTIONS_COUNTER], ipc,
+                    counts[CACHE_MISSES_COUNTER], counts[BRANCH_MISSES_COUNTER]);
+        }
+    }
+    else
+    {
+        fprintf(stderr, "  %-32s %12s\n", "phase", "wall ms");
+        for(int i=0; i<NUM_PHASES; i++)
+            fprintf(stderr, "  %-32s %12.3f\n", phase_names[i], phase_seconds[i] * 1000.0);
+        if(semant_option("SEMANT_PERF"))
+            fprintf(stderr, "  (hardware counters unavailable)\n");
+    }
+
+    ast_memory ast = { 0, 0 };
+    program->traverse(count_ast_node, &ast);
+    long graph_entries = inheritance_graph.size();
+    long graph_bytes = graph_entries * (sizeof(std::pair<const Symbol, Class_>) + map_node_overhead);
+
+    fprintf(stderr, "  %-32s %12s %12s\n", "memory", "count", "bytes");
+    fprintf(stderr, "  %-32s %12ld %12ld\n", "AST nodes", ast.nodes, ast.bytes);
+    fprintf(stderr, "  %-32s %12ld %12ld\n", "inheritance_graph entries", graph_entries, graph_bytes);
+    if(compact_store!=NULL)
+        fprintf(stderr, "  %-32s %12ld %12ld\n", "compact AST nodes", (long) compact_store->size(), (long) compact_store->bytes());
+    fprintf(stderr, "  %-32s %12ld %12s\n", "attribute_table scope frames", attribute_scope_memory.frames, "");
+    fprintf(stderr, "  %-32s %12ld %12ld\n", "attribute_table scope entries", attribute_scope_memory.entries, attribute_scope_memory.peak_bytes);
+    fprintf(stderr, "  %-32s %12ld %12ld\n", "Symbol payloads", attribute_scope_memory.payloads, attribute_scope_memory.payload_bytes);
+    fprintf(stderr, "  %-32s %12ld %12ld\n", "feature indexes", indexed_classes, feature_index_bytes);
+    if(ast_files_loaded>0)
     {
-        classtable->semant_error(cur_class)<<"Argument of 'not' has type "<<expr_type<<".\n";
-        type = Object;
-        return Object;
+        fprintf(stderr, "  %-32s %12ld %12s\n", "AST files loaded", ast_files_loaded, "");
+        fprintf(stderr, "  %-32s %12ld %12s\n", "  cross-file redefinitions", cross_file_redefinitions, "");
     }
-    type = Bool;
-    return Bool;
+    fprintf(stderr, "  %-32s %12ld %12ld\n", "interned symbols", (long) symbol_interner.size(), (long) symbol_interner.bytes());
+    fprintf(stderr, "  %-32s %12ld %12ld\n", "ancestor matrix rows", (long) (ancestor_words>0 ? tagged_classes.size() : 0),
+            (long) (ancestor_rows.capacity() * sizeof(unsigned long long)));
+    fprintf(stderr, "  %-32s %12ld %12ld\n", "ancestor subtree ranges", (long) parent_tags.size(),
+            (long) ((parent_tags.capacity() + subtree_ends.capacity()) * sizeof(size_t)));
+    fprintf(stderr, "  %-32s %12ld %12ld\n", "method signatures", (long) signatures.size(),
+            (long) (signatures.capacity() * sizeof(method_signature) + signature_types.capacity() * sizeof(Symbol)));
+    fprintf(stderr, "  %-32s %12ld %12ld\n", "dispatch sites", (long) dispatch_sites.size(), (long) (dispatch_sites.capacity() * sizeof(dispatch_site)));
+    fprintf(stderr, "  %-32s %12ld %12s\n", "  of which monomorphic", monomorphic_sites, "");
+    long non_void_operands = 0;
+    for(size_t i=0; i<void_check_operands.size(); i++)
+        non_void_operands += void_check_operands[i]->get_void_source()==NEVER_VOID;
+    fprintf(stderr, "  %-32s %12ld %12ld\n", "void checks", (long) void_check_operands.size(),
+            (long) (void_check_operands.capacity() * sizeof(Expression)));
+    fprintf(stderr, "  %-32s %12ld %12s\n", "  of which elided", non_void_operands, "");
+    fprintf(stderr, "  %-32s %12ld %12s\n", "let chains", let_chains, "");
+    fprintf(stderr, "  %-32s %12ld %12s\n", "  longest", longest_let_chain, "");
+    long call_edges = 0;
+    std::map<Feature, std::vector<call_edge> >::iterator calls;
+    for(calls = feature_calls.begin(); calls!=feature_calls.end(); calls++)
+        call_edges += calls->second.capacity();
+    fprintf(stderr, "  %-32s %12ld %12ld\n", "call edges", call_edges,
+            (long) (call_edges * sizeof(call_edge) + feature_calls.size() * (sizeof(std::pair<const Feature, std::vector<call_edge> >) + map_node_overhead)));
+    fprintf(stderr, "  %-32s %12ld %12ld\n", "live classes", (long) live_classes.size(),
+            (long) (live_classes.size() * (sizeof(Class_) + map_node_overhead)));
+    fprintf(stderr, "  %-32s %12ld %12ld\n", "reachable methods", (long) reachable_methods.size(),
+            (long) (reachable_methods.size() * (sizeof(std::pair<const Feature, Class_>) + map_node_overhead)));
+    fprintf(stderr, "  %-32s %12ld %12ld\n", "class tags", (long) class_tags.size(),
+            (long) (class_tags.size() * (sizeof(std::pair<const Symbol, class_tag>) + map_node_overhead) + tagged_classes.capacity() * sizeof(Class_)));
+    fprintf(stderr, "  %-32s %12ld %12ld\n", "class layouts", (long) class_layouts.size(),
+            (long) (class_layouts.capacity() * sizeof(class_layout) + layout_attributes.capacity() * sizeof(layout_attribute) +
+                    layout_methods.capacity() * sizeof(layout_method) + layout_index.size() * (sizeof(std::pair<const Symbol, int>) + map_node_overhead)));
+    fprintf(stderr, "  %-32s %12ld %12ld\n", "dispatch cache entries", (long) dispatch_cache.size(), (long) dispatch_cache.bytes());
+    if(memory_limit()>0)
+        fprintf(stderr, "  %-32s %12ld %12ld\n", "memory limit releases", memory_releases, (long) memory_limit());
+    fprintf(stderr, "  %-32s %12ld %12ld\n", "diagnostic records", (long) diagnostics.size(), (long) (diagnostics.capacity() * sizeof(diagnostic)));
+
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage)==0)
+        fprintf(stderr, "  %-32s %12s %12ld\n", "peak RSS", "", usage.ru_maxrss * 1024L);
 }
 
-Symbol int_const_class::get_expression_type(Class_ cur_class)
+/* checks one feature of `cur_class' in a scope of its own on top of the class scopes. */
+static void check_feature_in_class(Feature feature, Class_ cur_class)
 {
-    type = Int;
-    return Int;
+    attribute_table->enterscope();
+
+    current_feature = feature;
+    feature_calls[feature].clear();
+    begin_void_analysis();
+    feature->check_feature(cur_class);
+    finish_void_analysis();
+    current_feature = NULL;
+
+    attribute_table->exitscope();
 }
 
-Symbol bool_const_class::get_expression_type(Class_ cur_class)
+/* checks the features of one class against fresh scopes built from its ancestors. */
+static void check_class(Class_ cur_class)
 {
-    type = Bool;
-    return Bool;
+    attribute_table = &class_attributes;
+    report_declaration_errors(cur_class);
+    phase_begin(SCOPE_PHASE);
+    populate_symbol_tables(cur_class);
+    phase_end(SCOPE_PHASE);
+
+    phase_begin(CHECK_PHASE);
+    Features features = cur_class->get_features();
+    for(int i=features->first(); features->more(i); i=features->next(i))
+        check_feature_in_class(features->nth(i), cur_class);
+    phase_end(CHECK_PHASE);
+
+    class_attributes.clear();
+    enforce_memory_limit();
 }
 
-Symbol string_const_class::get_expression_type(Class_ cur_class)
+/* the whole-program analyses, run once every class has checked without errors. */
+static void analyze_program(Classes classes)
 {
-    type = Str;
-    return Str;
+    phase_begin(ANALYSIS_PHASE);
+    annotate_monomorphic_dispatches();
+    compute_reachability();
+    emit_reachable(classes);
+    compute_layouts();
+    emit_layouts(classes);
+    for(size_t i=0; i<typcase_sites.size(); i++)
+        typcase_sites[i]->annotate_branches();
+    phase_end(ANALYSIS_PHASE);
 }
 
-Symbol new__class::get_expression_type(Class_ cur_class)
+/*   This is the entry point to the semantic checker.
+
+     Your checker should do the following two things:
+
+     1) Check that the program is semantically correct
+     2) Decorate the abstract syntax tree with type information
+        by setting the `type' field in each Expression node.
+        (see `tree.h')
+
+     You are free to first do 1), make sure you catch all semantic
+     errors. Part 2) can be done in a second stage, when you want
+     to build mycoolc.
+ */
+void program_class::semant()
 {
-    if(type_name==SELF_TYPE)
-    {   
-        type = SELF_TYPE;
-        return type;
+    initialize_constants();
+    if(semant_option("SEMANT_PERF"))
+        open_perf_counters();
+
+    /* ClassTable constructor may do some semantic analysis */
+    phase_begin(CLASS_TABLE_PHASE);
+    classtable = new ClassTable(classes);
+    phase_end(CLASS_TABLE_PHASE);
+    if (classtable->errors()) {
+    flush_diagnostics();
+    print_semant_report(this);
+    cerr << "Compilation halted due to static semantic errors." << endl;
+    exit(1);
     }
-    if(inheritance_graph.find(type_name)==inheritance_graph.end())
+    /* some semantic analysis code may go here */
+    for(int i=classes->first(); classes->more(i); i=classes->next(i))
     {
-        classtable->semant_error(cur_class)<<"'new' used with undefined class "<<type_name<<endl;
-        type = Object;
-        return Object;
+        check_class(classes->nth(i));
     }
-    type = type_name;
-    return type_name;
-}
 
-Symbol isvoid_class::get_expression_type(Class_ cur_class)
-{
-    e1->get_expression_type(cur_class);
-    type = Bool;
-    return Bool;
+    if (!classtable->errors())
+        analyze_program(classes);
+
+    flush_diagnostics();
+    print_semant_report(this);
+    if (classtable->errors()) {
+    cerr << "Compilation halted due to static semantic errors." << endl;
+    exit(1);
+    }
 }
 
-Symbol no_expr_class::get_expression_type(Class_ cur_class)
+/*
+   The entry point for a program read into a CompactAst, e.g. by
+   read_compact_ast.  The tree is materialized from the store and
+   checked by semant(), with the same rules and diagnostics, and what
+   checking inferred is copied back into `ast'.  Returns the tree.
+   Exits like semant() does when there are errors.
+ */
+Program semant_compact(CompactAst &ast, unsigned int root)
 {
-    type = No_type;
-    return No_type;
+    Program program = ast.materialize(root);
+    compact_store = &ast;
+    program->semant();
+    compact_store = NULL;
+    ast.store_annotations();
+    return program;
 }
 
-Symbol object_class::get_expression_type(Class_ cur_class)
-{
-    if(name == self)
+//////////////////////////////////////////////////////////////////////
+//
+// Streaming analysis
+//
+// semant_streaming reads an AST file on a separate thread and checks
+// each class as soon as it and all of its ancestors have arrived,
+// instead of waiting for the whole Classes list.  The reader hands
+// classes to the checker through a bounded queue.  The reader sets
+// node_lineno for every node it builds, so until it is joined the
+// checker must not build tree nodes itself; check_class builds none.
+//
+// A class checked this way is checked against a partial class table,
+// so its errors are dropped.  Once the input is complete the real
+// ClassTable is built as in semant(), and every class whose early check
+// found errors (or that could not be checked early) is checked again.
+// Missing classes can only add errors, so a class that checked clean
+// early is clean, and the output is the same as semant()'s, in the
+// same order.
+//
+//////////////////////////////////////////////////////////////////////
+
+class ClassQueue {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    std::vector<Class_> ring;
+    unsigned int head;
+    unsigned int count;
+public:
+    ClassQueue(unsigned int capacity) : ring(capacity), head(0), count(0)
     {
-        type = SELF_TYPE;
-        return type;
+        pthread_mutex_init(&lock, NULL);
+        pthread_cond_init(&not_empty, NULL);
+        pthread_cond_init(&not_full, NULL);
     }
-    Symbol* obj_type = attribute_table->lookup(name);
-    if(obj_type==NULL)
+
+    ~ClassQueue()
     {
-        classtable->semant_error(cur_class)<<"Undefined identifier "<<name<<endl;
-        type = Object;
-        return Object;
+        pthread_cond_destroy(&not_full);
+        pthread_cond_destroy(&not_empty);
+        pthread_mutex_destroy(&lock);
     }
-    type = *obj_type;
-    return type;
-}
 
-void method_class::check_feature(Class_ cur_class)
-{
-    bool err_flag=false;
-    for(int i=formals->first();formals->more(i);i=formals->next(i))
+    void push(Class_ c)
     {
-        Formal formal = formals->nth(i);
-        Symbol formal_name = formal->get_name();
-        if(formal_name == self)
-        {
-            classtable->semant_error(cur_class)<<"'self' cannot be a formal parameter\n";
-            err_flag=true;
-        }
-        if(inheritance_graph.find(formal->get_type())==inheritance_graph.end())
-        {
-            classtable->semant_error(cur_class)<<"Class "<<formal->get_type()<<" of formal parameter "<<formal_name<<" is undefined\n";
-            err_flag=true;   
-        }
-        if(attribute_table->probe(formal_name)!=NULL)
-        {
-            classtable->semant_error(cur_class)<<"Formal parameter "<<formal_name<<" is multiply defined\n";
-            err_flag=true;
-        }
-        if(!err_flag)
-        {
-            attribute_table->addid(formal_name, new Symbol(formal->get_type()));
-        }
+        pthread_mutex_lock(&lock);
+        while(count==ring.size())
+            pthread_cond_wait(&not_full, &lock);
+        ring[(head + count) % ring.size()] = c;
+        count++;
+        pthread_cond_signal(&not_empty);
+        pthread_mutex_unlock(&lock);
     }
-    Symbol expr_type=expr->get_expression_type(cur_class);
-    Symbol r_type = return_type;
-    if(r_type==SELF_TYPE)
-        r_type=cur_class->get_name();
-    if(expr_type==SELF_TYPE)
-        expr_type=cur_class->get_name();
-    if(expr_type!=return_type && (!subClass(expr_type,return_type)))
+
+    Class_ pop()
     {
-        classtable->semant_error(cur_class)<<"Inferred return type "<<expr_type<<" of method "<<name<<" does not conform to declared type "<<return_type<<".\n";
+        pthread_mutex_lock(&lock);
+        while(count==0)
+            pthread_cond_wait(&not_empty, &lock);
+        Class_ c = ring[head];
+        head = (head + 1) % ring.size();
+        count--;
+        pthread_cond_signal(&not_full);
+        pthread_mutex_unlock(&lock);
+        return c;
     }
+};
 
+/* number of classes the reader may run ahead of the checker. */
+static const unsigned int stream_queue_capacity = 64;
 
-}
+struct stream_reader {
+    MappedAstReader *reader;
+    ClassQueue *queue;
+};
 
-void attr_class::check_feature(Class_ cur_class)
+/* reader thread: queues every class, then NULL for the end of input. */
+static void *read_classes(void *data)
 {
-    Symbol assigned_type = init->get_expression_type(cur_class);
-    if(assigned_type==SELF_TYPE)
-        assigned_type=cur_class->get_name();
-    Symbol decl_type = type_decl;
-    if(decl_type==SELF_TYPE)
-        decl_type=cur_class->get_name();
-    if(inheritance_graph.find(decl_type)==inheritance_graph.end())
+    stream_reader *stream = (stream_reader *) data;
+    Class_ c;
+    do
     {
-        classtable->semant_error(cur_class)<<"Class "<<type_decl<<" of attribute "<<name<<" is undefined"<<endl;
-    }
+        c = stream->reader->read_class();
+        stream->queue->push(c);
+    } while(c!=NULL);
+    return NULL;
+}
+
+/*
+   Adds a class to the partial class table under the rules of the
+   ClassTable constructor; classes those rules reject are left for the
+   real table to report.
+ */
+static void register_early(Class_ c)
+{
+    Symbol name = c->get_name();
+    Symbol parent = c->get_parent();
+    if(inheritance_graph.find(name)!=inheritance_graph.end() || name==parent || name==SELF_TYPE ||
+       parent==Bool || parent==Int || parent==Str || parent==SELF_TYPE)
+        return;
+    inheritance_graph.insert(std::pair<Symbol, Class_>(name, c));
+}
 
-    if(assigned_type!=No_type && assigned_type!=type_decl && (!subClass(assigned_type,type_decl)))
+/* true once the class and its whole ancestor chain up to Object are registered. */
+static bool ancestors_known(Class_ c)
+{
+    std::map<Symbol, Class_>::iterator it = inheritance_graph.find(c->get_name());
+    if(it==inheritance_graph.end() || it->second!=c)
+        return false;
+    Symbol parent = c->get_parent();
+    for(size_t steps=0; steps<=inheritance_graph.size(); steps++)
     {
-        classtable->semant_error(cur_class)<<"Inferred type "<<assigned_type<<" of initialization of attribute "<<name<<" does not conform to declared type "<<type_decl<<".\n";
+        if(parent==No_class || parent==Object)
+            return true;
+        it = inheritance_graph.find(parent);
+        if(it==inheritance_graph.end())
+            return false;
+        parent = it->second->get_parent();
     }
+    return false;
 }
 
-void method_class::add_to_symbol_table(Feature current_feature, Class_ cur_class)
+/*
+   Reads and checks the program in the AST file at `path' as described
+   above.  Returns the decorated program, or exits like semant() does
+   when there are errors.
+ */
+Program semant_streaming(const char *path)
 {
-    bool is_error=false;
-    if(function_table->probe(name)!=NULL)
+    initialize_constants();
+    if(semant_option("SEMANT_PERF"))
+        open_perf_counters();
+
+    MappedAstReader reader;
+    if(!reader.open(path))
     {
-        classtable->semant_error(cur_class)<<"Method "<<name<<" is multiply defined.\n";
-        return;
+        cerr << "Could not open AST file " << path << endl;
+        exit(1);
     }
+    reader.read_header();
 
-    if(function_table->lookup(name)!= NULL)
-    {
-        Feature inherited_feature = *(function_table->lookup(name));
-        Formals inherited_formals = inherited_feature->get_formals();
+    /*
+       Errors found before the real class table exists are speculative:
+       they only tell whether a class checked clean, and are discarded.
+       The first is the basic-class table's complaint about Main.
+     */
+    speculative_diagnostics = true;
+    classtable = new ClassTable(nil_Classes());
+    diagnostics.clear();
 
-        if(formals->len()!=inherited_formals->len())
-        {
-            classtable->semant_error(cur_class)<<"Incompatible number of formal parameters in redefined method "<<name<<".\n";
-            return;  
-        }
+    ClassQueue queue(stream_queue_capacity);
+    stream_reader stream = { &reader, &queue };
+    pthread_t reader_thread;
+    pthread_create(&reader_thread, NULL, read_classes, &stream);
 
-        for(int i=formals->first(); formals->more(i); i=formals->next(i))
-        {
-            Formal current_formal = formals->nth(i);
-            Formal inherited_formal = inherited_formals->nth(i);
+    /* classes in input order, whether each checked clean early, and how many were tried. */
+    std::vector<Class_> arrived;
+    std::vector<bool> clean;
+    std::vector<std::vector<diagnostic> > early_warnings;
+    size_t next_to_check = 0;
+    for(Class_ c = queue.pop(); c!=NULL; c = queue.pop())
+    {
+        arrived.push_back(c);
+        clean.push_back(false);
+        early_warnings.push_back(std::vector<diagnostic>());
+        register_early(c);
 
-            if(current_formal->get_type()!=inherited_formal->get_type())
+        /* check in input order, holding back everything behind a class whose ancestors are missing. */
+        while(next_to_check<arrived.size() && ancestors_known(arrived[next_to_check]))
+        {
+            size_t sites_before = dispatch_sites.size();
+            size_t cases_before = typcase_sites.size();
+            size_t operands_before = void_check_operands.size();
+            int errors_before = classtable->errors();
+            check_declarations(arrived[next_to_check]);
+            check_class(arrived[next_to_check]);
+            clean[next_to_check] = classtable->errors()==errors_before;
+            /* a clean class's warnings stand; they are emitted in input order below. */
+            if(clean[next_to_check])
+                early_warnings[next_to_check].swap(diagnostics);
+            diagnostics.clear();
+            /* a class that is checked again will record its call sites again. */
+            if(!clean[next_to_check])
             {
-                classtable->semant_error(cur_class)<<"In redefined method "<<name<<", parameter type "<<current_formal->get_type()<<" is different from original type "<<inherited_formal->get_type()<<".\n";
-                is_error=true;
-                break;
+                dispatch_sites.resize(sites_before);
+                typcase_sites.resize(cases_before);
+                void_check_operands.resize(operands_before);
             }
-        }
-
-        if(return_type!=inherited_feature->get_return_type())
-        {
-            classtable->semant_error(cur_class)<<"In redefined method "<<name<<", return type "<<return_type<<" is different from original return type "<<inherited_feature->get_return_type()<<".\n";
-            return;
+            next_to_check++;
         }
     }
-    if(!is_error)
-        function_table->addid(name, new Feature(current_feature));
+    pthread_join(reader_thread, NULL);
+    speculative_diagnostics = false;
 
-}
+    Classes classes = nil_Classes();
+    for(size_t i=0; i<arrived.size(); i++)
+        classes = append_Classes(classes, single_Classes(arrived[i]));
+    node_lineno = reader.program_line_number();
+    Program result = program(classes);
 
-void attr_class::add_to_symbol_table(Feature current_feature, Class_ cur_class)
-{
-    if(attribute_table->probe(name)!=NULL)
-    {
-        classtable->semant_error(cur_class)<<"Attribute "<<name<<" is multiply defined in class.\n";
-        return;
+    /* now the real class table, exactly as semant() builds it. */
+    inheritance_graph.clear();
+    phase_begin(CLASS_TABLE_PHASE);
+    classtable = new ClassTable(classes);
+    phase_end(CLASS_TABLE_PHASE);
+    if (classtable->errors()) {
+    flush_diagnostics();
+    print_semant_report(result);
+    cerr << "Compilation halted due to static semantic errors." << endl;
+    exit(1);
     }
 
-    if(attribute_table->lookup(name)!=NULL)
+    for(size_t i=0; i<arrived.size(); i++)
     {
-        classtable->semant_error(cur_class)<<"Attribute "<<name<<" is an attribute of an inherited class.\n";
-        return;
+        if(clean[i])
+            diagnostics.insert(diagnostics.end(), early_warnings[i].begin(), early_warnings[i].end());
+        else
+            check_class(arrived[i]);
     }
 
-    if(name==self)
-    {
-        classtable->semant_error(cur_class)<<"'self' cannot be the name of an attribute.\n";
-        return;
-    }
-    if(type_decl==SELF_TYPE){
-        attribute_table->addid(name, new Symbol(cur_class->get_name()));
-        return;
-    }    
-    attribute_table->addid(name, new Symbol(type_decl));
-}
+    if (!classtable->errors())
+        analyze_program(classes);
 
-void populate_symbol_tables(Class_ cur_class)
-{
-    Symbol parent = cur_class->get_parent();
-    if(parent!=No_class)
-    {
-        populate_symbol_tables(inheritance_graph.find(parent)->second);
+    flush_diagnostics();
+    print_semant_report(result);
+    if (classtable->errors()) {
+    cerr << "Compilation halted due to static semantic errors." << endl;
+    exit(1);
     }
+    return result;
+}
 
-    attribute_table->enterscope();
-    function_table->enterscope();
-
-    Features features = cur_class->get_features();
+//////////////////////////////////////////////////////////////////////
+//
+// Queries
+//
+// A QueryEngine answers questions about one source line for editor
+// tooling without checking the whole program.  It builds the class
+// table once; a query then checks only the method or attribute that
+// encloses the line, on top of scopes built for that feature's class.
+// The scopes are kept for later queries in the same class, and the
+// expressions of a checked feature are kept, ordered by line, until
+// invalidate() is called for it.  An edit that replaces a feature
+// with a new node never hits the memo, so it is checked afresh.
+//
+// Errors found while answering a query are not reported.  A program
+// whose class table has errors other than a missing Main cannot be
+// queried.  The class is declared in cool-tree.h.
+//
+//////////////////////////////////////////////////////////////////////
 
-    for(int i=features->first(); features->more(i); i=features->next(i))
-    {
-        Feature feature = features->nth(i);
-        feature->add_to_symbol_table(features->nth(i), cur_class);
-    }
+static bool span_before(const feature_span &a, const feature_span &b)
+{
+    return a.line < b.line;
 }
 
-/*   This is the entry point to the semantic checker.
-
-     Your checker should do the following two things:
+static bool located_before(const std::pair<int, Expression> &a, const std::pair<int, Expression> &b)
+{
+    return a.first < b.first;
+}
 
-     1) Check that the program is semantically correct
-     2) Decorate the abstract syntax tree with type information
-        by setting the `type' field in each Expression node.
-        (see `tree.h')
+static void collect_expression(tree_node *node, size_t, void *data)
+{
+    Expression e = dynamic_cast<Expression>(node);
+    if(e!=NULL)
+        ((located_expressions *) data)->push_back(std::pair<int, Expression>(e->get_line_number(), e));
+}
 
-     You are free to first do 1), make sure you catch all semantic
-     errors. Part 2) can be done in a second stage, when you want
-     to build mycoolc.
- */
-void program_class::semant()
+QueryEngine::QueryEngine(Program program) : usable(true)
 {
     initialize_constants();
+    Classes classes = program->get_classes();
 
-    /* ClassTable constructor may do some semantic analysis */
-    classtable = new ClassTable(classes);
-    if (classtable->errors()) {
-    cerr << "Compilation halted due to static semantic errors." << endl;
-    exit(1);
+    size_t diagnostics_before = diagnostics.size();
+    bool speculative = speculative_diagnostics;
+    speculative_diagnostics = true;
+    inheritance_graph.clear();
+    table = classtable = new ClassTable(classes);
+    for(size_t i=diagnostics_before; i<diagnostics.size(); i++)
+    {
+        if(diagnostics[i].code!=MAIN_UNDEFINED_ERROR)
+            usable = false;
     }
-    /* some semantic analysis code may go here */
+    diagnostics.resize(diagnostics_before);
+    speculative_diagnostics = speculative;
+
     for(int i=classes->first(); classes->more(i); i=classes->next(i))
     {
-        /* getting the current class. */
-        Class_ cur_class = classes->nth(i);
-        function_table = new SymbolTable<Symbol, Feature>();
-        attribute_table = new SymbolTable<Symbol, Symbol>();
-        populate_symbol_tables(cur_class);
-
-        Features features = cur_class->get_features();
-        for(int i=features->first(); features->more(i); i=features->next(i))
+        Class_ c = classes->nth(i);
+        std::vector<feature_span> &file = spans[c->get_filename()];
+        Features features = c->get_features();
+        for(int j=features->first(); features->more(j); j=features->next(j))
         {
-            Feature feature = features->nth(i);
+            feature_span span = { features->nth(j)->get_line_number(), features->nth(j), c };
+            file.push_back(span);
+        }
+    }
+    std::map<Symbol, std::vector<feature_span> >::iterator file;
+    for(file = spans.begin(); file!=spans.end(); file++)
+        std::stable_sort(file->second.begin(), file->second.end(), span_before);
+}
+
+/* the last feature starting at or before `line'; it runs until the next one starts. */
+const feature_span *QueryEngine::enclosing(Symbol filename, int line)
+{
+    std::map<Symbol, std::vector<feature_span> >::iterator file = spans.find(filename);
+    if(file==spans.end())
+        return NULL;
+    feature_span key = { line, NULL, NULL };
+    std::vector<feature_span>::iterator next = std::upper_bound(file->second.begin(), file->second.end(), key, span_before);
+    if(next==file->second.begin())
+        return NULL;
+    return &*(next - 1);
+}
 
-            attribute_table->enterscope();
-            function_table->enterscope();
+located_expressions &QueryEngine::check(const feature_span &span)
+{
+    std::map<Feature, located_expressions>::iterator found = checked.find(span.feature);
+    if(found!=checked.end())
+        return found->second;
 
-            feature->check_feature(cur_class);
+    size_t diagnostics_before = diagnostics.size();
+    size_t sites_before = dispatch_sites.size();
+    size_t cases_before = typcase_sites.size();
+    size_t operands_before = void_check_operands.size();
+    std::map<Feature, std::vector<call_edge> >::iterator calls = feature_calls.find(span.feature);
+    bool had_calls = calls!=feature_calls.end();
+    std::vector<call_edge> calls_before;
+    if(had_calls)
+        calls_before.swap(calls->second);
+    bool speculative = speculative_diagnostics;
+    speculative_diagnostics = true;
+    classtable = table;
 
-            attribute_table->exitscope();
-            function_table->exitscope();
+    class_scopes owner = scopes[span.owner];
+    if(owner==NULL)
+    {
+        owner = attribute_table = new ScopedTable<Symbol, Symbol>(&attribute_scope_memory);
+        scopes[span.owner] = owner;
+        populate_symbol_tables(span.owner);
+    }
+    attribute_table = owner;
+    check_feature_in_class(span.feature, span.owner);
 
+    /* under SEMANT_MAX_MEMORY the class scopes are a cache like any other. */
+    size_t limit = memory_limit();
+    if(limit>0)
+    {
+        size_t retained = 0;
+        std::map<Class_, class_scopes>::iterator it;
+        for(it = scopes.begin(); it!=scopes.end(); it++)
+            retained += it->second->bytes();
+        if(retained > limit)
+        {
+            release_scopes();
+            memory_releases++;
         }
     }
 
-    if (classtable->errors()) {
-    cerr << "Compilation halted due to static semantic errors." << endl;
-    exit(1);
+    /* a query leaves no trace in what a full check would report or analyze. */
+    speculative_diagnostics = speculative;
+    diagnostics.resize(diagnostics_before);
+    dispatch_sites.resize(sites_before);
+    typcase_sites.resize(cases_before);
+    void_check_operands.resize(operands_before);
+    if(had_calls)
+        feature_calls[span.feature].swap(calls_before);
+    else
+        feature_calls.erase(span.feature);
+
+    located_expressions &expressions = checked[span.feature];
+    span.feature->traverse(collect_expression, &expressions);
+    std::stable_sort(expressions.begin(), expressions.end(), located_before);
+    return expressions;
+}
+
+/* the expressions starting on `line', outermost first, as [first, last). */
+bool QueryEngine::expressions_at(Symbol filename, int line, located_expressions::iterator &first,
+                                 located_expressions::iterator &last)
+{
+    const feature_span *span = usable ? enclosing(filename, line) : NULL;
+    if(span==NULL)
+        return false;
+    located_expressions &expressions = check(*span);
+    std::pair<int, Expression> key(line, (Expression) NULL);
+    first = std::lower_bound(expressions.begin(), expressions.end(), key, located_before);
+    last = std::upper_bound(first, expressions.end(), key, located_before);
+    return first!=last;
+}
+
+Symbol QueryEngine::type_at(Symbol filename, int line)
+{
+    located_expressions::iterator first, last;
+    if(!expressions_at(filename, line, first, last))
+        return NULL;
+    return first->second->get_type();
+}
+
+Feature QueryEngine::method_at(Symbol filename, int line, Class_ *defining)
+{
+    located_expressions::iterator first, last;
+    if(!expressions_at(filename, line, first, last))
+        return NULL;
+    for(; first!=last; first++)
+    {
+        Feature method = first->second->get_resolved_method(defining);
+        if(method!=NULL)
+            return method;
     }
+    return NULL;
+}
+
+void QueryEngine::invalidate(Feature feature)
+{
+    checked.erase(feature);
+}
+
+QueryEngine::~QueryEngine()
+{
+    release_scopes();
+}
+
+/* drops the scopes kept for every class; they are rebuilt when next needed. */
+void QueryEngine::release_scopes()
+{
+    std::map<Class_, class_scopes>::iterator it;
+    for(it = scopes.begin(); it!=scopes.end(); it++)
+        delete it->second;
+    scopes.clear();
 }
@@ -0,0 +1,22 @@
+class Main inherits Base {
+   main() : Object { 0 };
+   size : Int;
+   f(x : Int) : Bool { true };
+};
+
+class Base {
+   size : Int;
+   size : String;
+   f(x : Int) : Int { x };
+   f() : Int { 1 };
+   g(a : Int, b : Int) : Int { a };
+   self : Int;
+};
+
+class Child inherits Base {
+   g(a : Int) : Int { a };
+};
+
+class Grandchild inherits Child {
+   g(a : Bool) : Int { 0 };
+};
@@ -0,0 +1,15 @@
+(* Type errors in method bodies; the class hierarchy itself is sound. *)
+class Main {
+   x : Int <- "not an int";
+
+   main() : Object {
+      {
+         x + true;
+         undefined;
+         new Missing;
+         x.nothing();
+      }
+   };
+
+   f(a : Int, a : Bool) : Int { a };
+};
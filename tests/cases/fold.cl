@@ -0,0 +1,17 @@
+(* Constant folding: the folded values, and the warnings for faults it finds. *)
+class Main {
+   x : Int <- 2 * 3 + 4;
+
+   main() : Object {
+      {
+         x / 0;
+         10 / (5 - 5);
+         2147483648;
+         if 1 < 2 then 1 else 2 fi;
+         while false loop x pool;
+         not (3 <= 2);
+         ~(4 - 7) = 3;
+         x + 1;
+      }
+   };
+};
@@ -0,0 +1,41 @@
+(*
+   Class hierarchy analysis and rapid type analysis: which calls have a
+   single target, what is reachable from Main.main, and the object
+   layouts and dispatch tables.
+ *)
+class Main inherits IO {
+   shape : Shape <- new Square;
+   size : Int;
+
+   main() : Object {
+      {
+         out_int(shape.area());
+         out_int((new Circle).area());
+         out_string(shape.name());
+         size <- (new Square)@Shape.area();
+         if isvoid shape then abort() else self fi;
+         isvoid new Square;
+      }
+   };
+};
+
+class Shape {
+   name() : String { "shape" };
+   area() : Int { 0 };
+};
+
+class Square inherits Shape {
+   side : Int <- 2;
+   area() : Int { side * side };
+};
+
+class Circle inherits Shape {
+   radius : Int <- 1;
+   area() : Int { 3 * radius * radius };
+   grow() : Circle { { radius <- radius + 1; self; } };
+};
+
+class Unused inherits Square {
+   corners : Int <- 4;
+   area() : Int { 42 };
+};
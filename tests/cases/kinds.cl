@@ -0,0 +1,30 @@
+(* Every kind of node, in a program that type-checks. *)
+class Main inherits IO {
+   count : Int;
+   name : String <- "tab\there, quote \" and newline\n";
+   flag : Bool <- not true;
+
+   main() : Object {
+      {
+         count <- count + 1 - 2 * 3 / 4;
+         if count < 0 then out_string(name) else out_int(~count) fi;
+         while count <= 10 loop count <- count + 1 pool;
+         let a : Int <- 5, b : Bool, c : A <- new B in
+            case c of
+               x : B => x.f(a);
+               y : A => y@A.f(a);
+               z : Object => 0;
+            esac;
+         flag = isvoid self;
+         self;
+      }
+   };
+};
+
+class A {
+   f(n : Int) : Int { n };
+};
+
+class B inherits A {
+   f(n : Int) : Int { n + 1 };
+};
@@ -0,0 +1,34 @@
+(*
+   Classes arrive before their parents, so semant_streaming has to hold
+   them back until Shape is read, and Maker refers to a class that has
+   not arrived when it is first checked, so it is checked again.
+ *)
+class Main inherits IO {
+   main() : Object {
+      let s : Shape <- new Square in
+         case s of
+            q : Square => out_string(q.name());
+            r : Rect => out_string(r.name());
+            t : Shape => out_string(t.name());
+         esac
+   };
+};
+
+class Square inherits Rect {
+   name() : String { "square" };
+};
+
+class Rect inherits Shape {
+   name() : String { "rect" };
+};
+
+class Shape {
+   name() : String { "shape" };
+};
+
+class Maker inherits Shape {
+   make() : Late { new Late };
+};
+
+class Late inherits Square {
+};
@@ -0,0 +1,12 @@
+(* Each error is reported once; expressions built on a failed one stay quiet. *)
+class Main {
+   main() : Object {
+      {
+         (true + 1) * 2 - 3;
+         undefined.length() + 1;
+         let y : Missing <- new Missing in y.foo();
+         case nowhere of i : Int => i + 1; esac;
+         if 1 + "two" then 3 else 4 fi;
+      }
+   };
+};
@@ -0,0 +1,17 @@
+(* Identifiers bound with let as SELF_TYPE keep that type. *)
+class Main inherits IO {
+   main() : Object {
+      let me : SELF_TYPE <- self, other : SELF_TYPE <- me.copy() in
+         {
+            other <- me;
+            other.out_string("same\n");
+         }
+   };
+};
+
+class Counter {
+   n : Int;
+   twin() : Object {
+      let c : SELF_TYPE <- copy() in c.twin()
+   };
+};
@@ -0,0 +1,309 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Test driver
+//
+// Runs the semantic analyzer's entry points on AST files the way a
+// test needs them; see run.sh, which links this against an assignment
+// directory in place of semant-phase.o.
+//
+//   driver tree f.ast             check the tree read from a text AST
+//   driver stream f.ast           the same with semant_streaming
+//   driver annotate f.ast         check the tree and print what the
+//                                 analyses recorded on its nodes
+//   driver query f.ast            ask a QueryEngine about every line
+//   driver roundtrip f.ast f.bin  write f.bin, read it back and dump it
+//                                 unchecked, which must give f.ast
+//   driver binary f.bin           check a binary AST in the compact store
+//   driver corrupt f.bin tmp      damage f.bin in various ways; each
+//                                 copy must be rejected
+//
+// The checked modes print the decorated tree like semant-phase does.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "cool-tree.h"
+
+static void usage()
+{
+    cerr << "usage: driver tree|stream|annotate|query|binary file | roundtrip f.ast f.bin | corrupt f.bin tmp" << endl;
+    exit(2);
+}
+
+/*
+   Prints, one line per node, the folded constants, known predicates,
+   void checks found unnecessary, monomorphic dispatches and case
+   branch orders.
+ */
+static void print_annotations(tree_node *node, size_t, void *)
+{
+    int line = node->get_line_number();
+    int value;
+    Expression e = dynamic_cast<Expression>(node);
+    if(e!=NULL && e->get_constant(value) && dynamic_cast<int_const_class *>(node)==NULL &&
+       dynamic_cast<bool_const_class *>(node)==NULL)
+        cout << line << ": folded to " << value << endl;
+
+    if(cond_class *cond = dynamic_cast<cond_class *>(node))
+    {
+        if(cond->get_known_pred()!=-1)
+            cout << line << ": if predicate is always " << cond->get_known_pred() << endl;
+    }
+    else if(loop_class *loop = dynamic_cast<loop_class *>(node))
+    {
+        if(loop->get_known_pred()!=-1)
+            cout << line << ": while predicate is always " << loop->get_known_pred() << endl;
+    }
+    else if(isvoid_class *test = dynamic_cast<isvoid_class *>(node))
+    {
+        if(test->operand_non_void())
+            cout << line << ": isvoid operand is never void" << endl;
+    }
+    else if(dispatch_class *call = dynamic_cast<dispatch_class *>(node))
+    {
+        Class_ defining;
+        Feature method = call->get_resolved_method(&defining);
+        cout << line << ": dispatch to " << defining->get_name() << "." << method->get_name();
+        if(call->get_target()!=NULL)
+            cout << ", only " << call->get_target_class()->get_name() << "." << call->get_target()->get_name();
+        if(call->receiver_non_void())
+            cout << ", receiver never void";
+        cout << endl;
+    }
+    else if(typcase_class *tc = dynamic_cast<typcase_class *>(node))
+    {
+        const std::vector<Case> &branches = tc->get_sorted_cases();
+        cout << line << ": case";
+        for(size_t i=0; i<branches.size(); i++)
+        {
+            branch_class *b = (branch_class *) branches[i];
+            cout << " " << b->get_type_decl() << "[" << b->get_tag_low() << "," << b->get_tag_high() << "]";
+        }
+        cout << endl;
+    }
+}
+
+static void last_line(tree_node *node, size_t, void *data)
+{
+    int *last = (int *) data;
+    if(node->get_line_number() > *last)
+        *last = node->get_line_number();
+}
+
+/* prints the type and the dispatch target a QueryEngine finds on each line of the first file. */
+static void query(Program program)
+{
+    int last = 0;
+    program->traverse(last_line, &last);
+    Symbol filename = program->get_classes()->nth(0)->get_filename();
+    QueryEngine engine(program);
+    for(int line=1; line<=last; line++)
+    {
+        Symbol type = engine.type_at(filename, line);
+        if(type==NULL)
+            continue;
+        cout << line << ": " << type;
+        Class_ defining;
+        Feature method = engine.method_at(filename, line, &defining);
+        if(method!=NULL)
+            cout << ", calls " << defining->get_name() << "." << method->get_name();
+        cout << endl;
+    }
+}
+
+static bool read_file(const char *path, std::vector<char> &bytes)
+{
+    FILE *file = fopen(path, "rb");
+    if(file==NULL)
+        return false;
+    char buffer[4096];
+    size_t n;
+    bytes.clear();
+    while((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        bytes.insert(bytes.end(), buffer, buffer + n);
+    fclose(file);
+    return true;
+}
+
+static bool write_file(const char *path, const std::vector<char> &bytes, size_t length)
+{
+    FILE *file = fopen(path, "wb");
+    if(file==NULL)
+        return false;
+    bool ok = length==0 || fwrite(&bytes[0], 1, length, file)==length;
+    return fclose(file)==0 && ok;
+}
+
+static bool rejected(const char *path)
+{
+    CompactAst ast;
+    unsigned int root;
+    return !read_binary_ast(path, ast, root);
+}
+
+static void report(const char *label, const char *path)
+{
+    cout << label << ": " << (rejected(path) ? "rejected" : "accepted") << endl;
+}
+
+/* rewrites one 32-bit header field (see the binary AST format in semant.cc). */
+static void report_header(const char *label, const std::vector<char> &bytes, size_t offset,
+                          unsigned int value, const char *tmp)
+{
+    std::vector<char> copy(bytes);
+    memcpy(&copy[offset], &value, sizeof(value));
+    write_file(tmp, copy, copy.size());
+    report(label, tmp);
+}
+
+static unsigned int header_field(const std::vector<char> &bytes, size_t offset)
+{
+    unsigned int value;
+    memcpy(&value, &bytes[offset], sizeof(value));
+    return value;
+}
+
+/* the first node of the given kind, or 0. */
+static unsigned int find_kind(CompactAst &ast, compact_kind kind)
+{
+    for(unsigned int node=0; node<ast.kinds.size(); node++)
+    {
+        if(ast.kinds[node]==kind)
+            return node;
+    }
+    return 0;
+}
+
+static void corrupt(const char *path, const char *tmp)
+{
+    std::vector<char> bytes;
+    CompactAst good;
+    unsigned int root;
+    if(!read_file(path, bytes) || !read_binary_ast(path, good, root))
+    {
+        cerr << "driver: cannot read " << path << endl;
+        exit(2);
+    }
+    report("intact", path);
+
+    /* every proper prefix of the file. */
+    size_t accepted = 0;
+    for(size_t length=0; length<bytes.size(); length++)
+    {
+        write_file(tmp, bytes, length);
+        if(!rejected(tmp))
+            accepted++;
+    }
+    cout << "truncated: " << accepted << " of " << bytes.size() << " prefixes accepted" << endl;
+
+    std::vector<char> magic(bytes);
+    magic[0] = 'X';
+    write_file(tmp, magic, magic.size());
+    report("bad magic", tmp);
+    report_header("future version", bytes, 8, header_field(bytes, 8) + 1, tmp);
+    report_header("swapped byte order", bytes, 12, 0x04030201, tmp);
+    report_header("root past the end", bytes, 16, header_field(bytes, 20), tmp);
+    report_header("extra node", bytes, 20, header_field(bytes, 20) + 1, tmp);
+    report_header("no symbols", bytes, 28, 0, tmp);
+    report_header("huge text section", bytes, 32, 0xffffffff, tmp);
+
+    /* damage the store itself, so the file is well formed but the tree is not. */
+    unsigned int klass = find_kind(good, CLASS_NODE);
+    unsigned int assign = find_kind(good, ASSIGN_NODE);
+    unsigned int classes = good.operands[root].a;
+    struct store_damage {
+        const char *label;
+        unsigned int *field;
+        unsigned int value;
+    } damage[] = {
+        { "root is a class", &root, klass },
+        { "class name is no symbol", &good.operands[klass].a, 0 },
+        { "class name past the symbols", &good.operands[klass].a, (unsigned int) good.symbols.size() },
+        { "type past the symbols", &good.types[assign], (unsigned int) good.symbols.size() },
+        { "assign reads itself", &good.operands[assign].b, assign },
+        { "class list past the items", &good.operands[root].a, (unsigned int) good.list_items.size() },
+        { "class list too long", &good.list_items[classes], (unsigned int) good.list_items.size() },
+    };
+    for(size_t i=0; i<sizeof(damage)/sizeof(damage[0]); i++)
+    {
+        unsigned int saved = *damage[i].field;
+        *damage[i].field = damage[i].value;
+        write_binary_ast(good, root, tmp);
+        report(damage[i].label, tmp);
+        *damage[i].field = saved;
+    }
+
+    unsigned char kind = good.kinds[assign];
+    good.kinds[assign] = NUM_COMPACT_KINDS;
+    write_binary_ast(good, root, tmp);
+    report("unknown node kind", tmp);
+    good.kinds[assign] = kind;
+
+    unsigned char table = good.symbol_tables[1];
+    good.symbol_tables[1] = STRING_SYMBOL + 1;
+    write_binary_ast(good, root, tmp);
+    report("unknown symbol table", tmp);
+    good.symbol_tables[1] = table;
+
+    write_binary_ast(good, root, tmp);
+    report("rewritten", tmp);
+}
+
+int main(int argc, char **argv)
+{
+    if(argc<3)
+        usage();
+    const char *mode = argv[1];
+    if(!strcmp(mode, "tree"))
+    {
+        Program program = read_mapped_ast(argv[2]);
+        if(program==NULL)
+            return 1;
+        program->semant();
+        program->dump_with_types(cout, 0);
+    }
+    else if(!strcmp(mode, "annotate"))
+    {
+        Program program = read_mapped_ast(argv[2]);
+        if(program==NULL)
+            return 1;
+        program->semant();
+        program->traverse(print_annotations, NULL);
+    }
+    else if(!strcmp(mode, "query"))
+    {
+        Program program = read_mapped_ast(argv[2]);
+        if(program==NULL)
+            return 1;
+        query(program);
+    }
+    else if(!strcmp(mode, "stream"))
+        semant_streaming(argv[2])->dump_with_types(cout, 0);
+    else if(!strcmp(mode, "roundtrip") && argc==4)
+    {
+        Program program = read_mapped_ast(argv[2]);
+        if(program==NULL || !write_binary_ast(program, argv[3]))
+            return 1;
+        Program copy = read_binary_program(argv[3]);
+        if(copy==NULL)
+            return 1;
+        copy->dump_with_types(cout, 0);
+    }
+    else if(!strcmp(mode, "binary"))
+    {
+        CompactAst ast;
+        unsigned int root;
+        if(!read_binary_ast(argv[2], ast, root))
+            return 1;
+        semant_compact(ast, root);
+        dump_typed_ast(ast, root, cout);
+    }
+    else if(!strcmp(mode, "corrupt") && argc==4)
+        corrupt(argv[2], argv[3]);
+    else
+        usage();
+    return 0;
+}
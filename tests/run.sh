@@ -0,0 +1,116 @@
+#!/bin/sh
+#
+# Regression tests for the semantic analyzer.
+#
+#   tests/run.sh [PA4 directory]
+#
+# The directory (default: the current one) is an assignment directory
+# in which this semant.cc and cool-tree.h have been built with
+# `make semant'.  driver.cc is linked against its objects in place of
+# semant-phase.o.
+#
+# Each cases/NAME.cl has the AST the parser gives for it in NAME.ast
+# and the expected output of the checker, stdout then stderr, then the
+# exit status, in NAME.out.  A case may also have
+#
+#   NAME.annotations  what the analyses record on the nodes
+#   NAME.query        what a QueryEngine answers for each line, with
+#                     and without its class scopes cached
+#   NAME.reachable    the SEMANT_REACHABLE file
+#   NAME.layout       the SEMANT_LAYOUT file
+#
+# each followed by the exit status.  Set UPDATE=1 to rewrite the
+# expected files.
+#
+
+TESTS=$(cd "$(dirname "$0")" && pwd)
+PA4=$(cd "${1:-.}" && pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+OBJS=$(ls "$PA4"/*.o | grep -v '/semant-phase\.o$')
+${CXX:-g++} -g -Wall -Wno-unused -Wno-write-strings -I"$PA4" -I"$PA4/../../include/PA4" \
+    "$TESTS/driver.cc" $OBJS -pthread -o "$WORK/driver" || exit 1
+
+failed=0
+
+# quiet COMMAND...: runs COMMAND without its stderr.
+quiet()
+{
+    "$@" 2>/dev/null
+}
+
+# emit OPTION f.ast: prints the file the checker writes for SEMANT_OPTION.
+emit()
+{
+    option=SEMANT_$(echo "$1" | tr a-z A-Z)
+    rm -f "$WORK/emitted"
+    env "$option=$WORK/emitted" "$WORK/driver" tree "$2" >/dev/null 2>&1 && cat "$WORK/emitted"
+}
+
+# expect NAME EXPECTED COMMAND...: runs COMMAND and compares its output with EXPECTED.
+expect()
+{
+    label=$1
+    expected=$2
+    shift 2
+    "$@" >"$WORK/stdout" 2>"$WORK/stderr"
+    status=$?
+    { cat "$WORK/stdout" "$WORK/stderr"; echo "exit $status"; } >"$WORK/actual"
+    case "$UPDATE:$expected" in
+    ?*:"$TESTS"/cases/*) cp "$WORK/actual" "$expected" ;;
+    esac
+    if cmp -s "$WORK/actual" "$expected"; then
+        echo "PASS $label"
+    else
+        echo "FAIL $label"
+        diff "$expected" "$WORK/actual" | head -20
+        failed=1
+    fi
+}
+
+cd "$TESTS/cases"
+for ast in *.ast; do
+    name=${ast%.ast}
+    expect "$name" "$TESTS/cases/$name.out" "$WORK/driver" tree "$ast"
+    expect "$name (streaming)" "$TESTS/cases/$name.out" "$WORK/driver" stream "$ast"
+    if [ -f "$name.annotations" ]; then
+        expect "$name (annotations)" "$TESTS/cases/$name.annotations" "$WORK/driver" annotate "$ast"
+    fi
+    if [ -f "$name.query" ]; then
+        expect "$name (query)" "$TESTS/cases/$name.query" "$WORK/driver" query "$ast"
+        expect "$name (query, uncached)" "$TESTS/cases/$name.query" \
+            env SEMANT_MAX_MEMORY=1 "$WORK/driver" query "$ast"
+    fi
+    for option in reachable layout; do
+        if [ -f "$name.$option" ]; then
+            expect "$name ($option)" "$TESTS/cases/$name.$option" emit $option "$ast"
+        fi
+    done
+
+    # the binary format must carry the parsed tree unchanged
+    { cat "$ast"; echo "exit 0"; } >"$WORK/parsed"
+    expect "$name (binary round trip)" "$WORK/parsed" "$WORK/driver" roundtrip "$ast" "$WORK/$name.bin"
+    expect "$name (binary)" "$TESTS/cases/$name.out" "$WORK/driver" binary "$WORK/$name.bin"
+done
+
+# a malformed SEMANT_MAX_MEMORY or SEMANT_MAX_ERRORS is ignored with a warning
+expect "max memory suffix" "$TESTS/cases/max memory suffix.out" env SEMANT_MAX_MEMORY=10x "$WORK/driver" tree errors.ast
+expect "max memory overflow" "$TESTS/cases/max memory overflow.out" \
+    env SEMANT_MAX_MEMORY=99999999999999999999g "$WORK/driver" tree errors.ast
+expect "max errors" "$TESTS/cases/max errors.out" env SEMANT_MAX_ERRORS=2 "$WORK/driver" tree errors.ast
+expect "max errors suffix" "$TESTS/cases/max errors suffix.out" env SEMANT_MAX_ERRORS=10x "$WORK/driver" tree errors.ast
+expect "max errors negative" "$TESTS/cases/max errors negative.out" env SEMANT_MAX_ERRORS=-1 "$WORK/driver" tree errors.ast
+expect "max errors overflow" "$TESTS/cases/max errors overflow.out" \
+    env SEMANT_MAX_ERRORS=99999999999999999999 "$WORK/driver" tree errors.ast
+
+# the same joins with and without the ancestor matrix
+for more in 0 4000; do
+    "$TESTS/wide.sh" $more >"$WORK/wide.ast"
+    expect "wide, $more more classes (query)" "$TESTS/cases/wide.query" "$WORK/driver" query "$WORK/wide.ast"
+done
+
+"$WORK/driver" roundtrip kinds.ast "$WORK/kinds.bin" >/dev/null
+expect corrupt "$TESTS/cases/corrupt.out" quiet "$WORK/driver" corrupt "$WORK/kinds.bin" "$WORK/damaged.bin"
+
+exit $failed
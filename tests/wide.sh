@@ -0,0 +1,148 @@
+#!/bin/sh
+#
+# Prints the AST of a program with a chain of classes Chain1 ..
+# Chain100, a class LeafI under each ChainI, and N more (default 4000)
+# spread over the chain.  The query answers are the same for every N;
+# with more than 4096 classes in all, the checker finds them without
+# its ancestor matrix.
+#
+
+N=${1:-4000}
+
+cat <<'AST'
+#1
+_program
+  #1
+  _class
+    Main
+    Object
+    "wide.cl"
+    (
+    #2
+    _method
+      main
+      Object
+      #3
+      _block
+        #4
+        _cond
+          #4
+          _bool
+            1
+          : _no_type
+          #4
+          _new
+            Leaf90
+          : _no_type
+          #4
+          _new
+            Leaf60
+          : _no_type
+        : _no_type
+        #5
+        _cond
+          #5
+          _bool
+            1
+          : _no_type
+          #5
+          _new
+            Leaf5
+          : _no_type
+          #5
+          _new
+            Chain100
+          : _no_type
+        : _no_type
+        #6
+        _typcase
+          #6
+          _int
+            0
+          : _no_type
+          #6
+          _branch
+            a
+            Leaf1
+            #6
+            _new
+              Leaf1
+            : _no_type
+          #6
+          _branch
+            b
+            Leaf100
+            #6
+            _new
+              Leaf100
+            : _no_type
+          #6
+          _branch
+            c
+            Chain70
+            #6
+            _new
+              Chain70
+            : _no_type
+        : _no_type
+        #7
+        _cond
+          #7
+          _bool
+            1
+          : _no_type
+          #7
+          _new
+            Leaf7
+          : _no_type
+          #7
+          _new
+            IO
+          : _no_type
+        : _no_type
+        #8
+        _cond
+          #8
+          _bool
+            1
+          : _no_type
+          #8
+          _new
+            Chain9
+          : _no_type
+          #8
+          _new
+            Chain9
+          : _no_type
+        : _no_type
+        #9
+        _cond
+          #9
+          _bool
+            1
+          : _no_type
+          #9
+          _new
+            Chain40
+          : _no_type
+          #9
+          _new
+            Leaf41
+          : _no_type
+        : _no_type
+      : _no_type
+    )
+AST
+
+awk -v n="$N" '
+function class(line, name, parent) {
+    printf "  #%d\n  _class\n    %s\n    %s\n    \"wide.cl\"\n    (\n    )\n", line, name, parent
+}
+BEGIN {
+    for(i=1; i<=100; i++) {
+        class(2*i+11, "Chain" i, i==1 ? "Object" : "Chain" (i - 1))
+        class(2*i+12, "Leaf" i, "Chain" i)
+    }
+    for(i=1; i<=n; i++)
+        class(212+i, "Spread" i, "Chain" (i % 100 + 1))
+}'